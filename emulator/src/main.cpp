@@ -1,6 +1,5 @@
 #include <string>
 #include <libriscv/machine.hpp>
-static inline std::vector<uint8_t> load_file(const std::string&);
 
 static constexpr uint64_t MAX_MEMORY = 1024 * 1024 * 24;
 static constexpr bool full_linux_guest = false;
@@ -17,14 +16,20 @@ int main(int argc, const char** argv)
 	}
 	const std::string filename = argv[1];
 
-	const auto binary = load_file(filename);
+	// the read-only segments are used directly from the file
+	const auto binary = riscv::BinaryView::map_file(filename);
 
 	std::vector<std::string> args = {
 		"hello_world", "test!"
 	};
 
 	riscv::verbose_machine = false;
-	riscv::Machine<riscv::RISCV32> machine { binary, MAX_MEMORY };
+	riscv::MachineOptions options { .memory_max = MAX_MEMORY };
+#ifdef RISCV_BINARY_TRANSLATION
+	// a shared object made from the program by rvtranslate
+	if (argc > 2) options.translation = argv[2];
+#endif
+	riscv::Machine<riscv::RISCV32> machine { binary, options };
 
 	// somewhere to store the guest outputs and exit status
 	State<riscv::RISCV32> state;
@@ -122,24 +127,3 @@ int main(int argc, const char** argv)
 			machine.memory.pages_highest_active(), machine.memory.pages_highest_active() * 4);
 	return 0;
 }
-
-#include <unistd.h>
-std::vector<uint8_t> load_file(const std::string& filename)
-{
-    size_t size = 0;
-    FILE* f = fopen(filename.c_str(), "rb");
-    if (f == NULL) throw std::runtime_error("Could not open file: " + filename);
-
-    fseek(f, 0, SEEK_END);
-    size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    std::vector<uint8_t> result(size);
-    if (size != fread(result.data(), 1, size, f))
-    {
-        fclose(f);
-        throw std::runtime_error("Error when reading from file: " + filename);
-    }
-    fclose(f);
-    return result;
-}
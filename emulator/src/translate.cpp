@@ -0,0 +1,92 @@
+#include <cerrno>
+#include <string>
+#include <sstream>
+#include <libriscv/machine.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+static inline std::vector<uint8_t> load_file(const std::string&);
+static int compile(const std::string& source, const std::string& output);
+
+static constexpr uint64_t MAX_MEMORY = 1024 * 1024 * 24;
+
+// Translates the execute segment of a RISC-V program to C, and builds it
+// into a shared object with the host compiler ($CC, or cc), which remu
+// loads with the program when it was built with RISCV_BINARY_TRANSLATION.
+int main(int argc, const char** argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <program> <output.so>\n", argv[0]);
+		exit(1);
+	}
+	const std::string filename = argv[1];
+	const std::string output = argv[2];
+
+	const auto binary = load_file(filename);
+	riscv::verbose_machine = false;
+	riscv::Machine<riscv::RISCV32> machine { binary, MAX_MEMORY };
+
+	const auto source = riscv::Translation<riscv::RISCV32>::generate(machine);
+	const std::string source_file = output + ".c";
+	FILE* f = fopen(source_file.c_str(), "wb");
+	if (f == NULL) throw std::runtime_error("Could not open file: " + source_file);
+	const bool written = fwrite(source.data(), 1, source.size(), f) == source.size();
+	fclose(f);
+	if (!written) throw std::runtime_error("Error when writing to file: " + source_file);
+
+	return (compile(source_file, output) == 0) ? 0 : 1;
+}
+
+// Runs the compiler directly, without a shell, so that nothing in the
+// file names is ever interpreted. $CC is split on whitespace only.
+int compile(const std::string& source, const std::string& output)
+{
+	const char* cc = getenv("CC");
+	std::vector<std::string> args;
+	std::istringstream words { cc ? cc : "cc" };
+	for (std::string word; words >> word; ) args.push_back(word);
+	if (args.empty()) args.push_back("cc");
+	for (const char* arg : { "-O2", "-shared", "-fPIC", "-o" })
+		args.push_back(arg);
+	args.push_back(output);
+	args.push_back(source);
+
+	std::vector<char*> argv;
+	for (auto& arg : args) {
+		printf("%s ", arg.c_str());
+		argv.push_back(arg.data());
+	}
+	printf("\n");
+	argv.push_back(nullptr);
+
+	const pid_t pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0) {
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return -1;
+	}
+	return (WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+}
+
+std::vector<uint8_t> load_file(const std::string& filename)
+{
+    size_t size = 0;
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (f == NULL) throw std::runtime_error("Could not open file: " + filename);
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    std::vector<uint8_t> result(size);
+    if (size != fread(result.data(), 1, size, f))
+    {
+        fclose(f);
+        throw std::runtime_error("Error when reading from file: " + filename);
+    }
+    fclose(f);
+    return result;
+}
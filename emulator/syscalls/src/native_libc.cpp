@@ -33,8 +33,8 @@ void setup_native_heap_syscalls(Machine<W>& machine, size_t max_memory)
 		auto data = arena->malloc(len);
 		SYSPRINT("SYSCALL calloc(%zu, %zu) = 0x%X\n", count, size, data);
 		if (data != 0) {
-			// TODO: optimize this (CoW), **can throw**
-			machine.memory.memset(data, 0, len);
+			// untouched pages stay CoW, **can throw**
+			machine.memory.zero_range(data, len);
 		}
 		return data;
 	});
@@ -82,34 +82,7 @@ void setup_native_memory_syscalls(Machine<W>& machine, bool trusted)
 				m.template sysargs<address_type<W>, address_type<W>, address_type<W>> ();
 			SYSPRINT("SYSCALL memcpy(%#X, %#X, %u)\n", dst, src, len);
 			m.cpu.increment_counter(2 * len);
-			if ((dst & 3) == (src & 3)) {
-				while ((src & 3) != 0 && len > 0) {
-					m.memory.template write<uint8_t> (dst++,
-						m.memory.template read<uint8_t> (src++));
-					len --;
-				}
-				while (len >= 16) {
-					m.memory.template write<uint32_t> (dst + 0,
-						m.memory.template read<uint32_t> (src + 0));
-					m.memory.template write<uint32_t> (dst + 4,
-						m.memory.template read<uint32_t> (src + 4));
-					m.memory.template write<uint32_t> (dst + 8,
-						m.memory.template read<uint32_t> (src + 8));
-					m.memory.template write<uint32_t> (dst + 12,
-						m.memory.template read<uint32_t> (src + 12));
-					dst += 16; src += 16; len -= 16;
-				}
-				while (len >= 4) {
-					m.memory.template write<uint32_t> (dst,
-						m.memory.template read<uint32_t> (src));
-					dst += 4; src += 4; len -= 4;
-				}
-			}
-			while (len > 0) {
-				m.memory.template write<uint8_t> (dst++,
-					m.memory.template read<uint8_t> (src++));
-				len --;
-			}
+			m.memory.copy_within(dst, src, len);
 			return dst;
 		});
 		// Memset n+5
@@ -119,9 +92,7 @@ void setup_native_memory_syscalls(Machine<W>& machine, bool trusted)
 			const auto [dst, value, len] = 
 				m.template sysargs<address_type<W>, address_type<W>, address_type<W>> ();
 			SYSPRINT("SYSCALL memset(%#X, %#X, %u)\n", dst, value, len);
-			for (size_t i = 0; i < len; i++) {
-				m.memory.template write<uint8_t> (dst + i, value);
-			}
+			m.memory.fill(dst, value, len);
 			m.cpu.increment_counter(len);
 			return dst;
 		});
@@ -162,18 +133,7 @@ void setup_native_memory_syscalls(Machine<W>& machine, bool trusted)
 		auto [dst, src, len] = 
 			m.template sysargs<address_type<W>, address_type<W>, address_type<W>> ();
 		SYSPRINT("SYSCALL memmove(%#X, %#X, %u)\n", dst, src, len);
-		if (src < dst)
-		{
-			for (unsigned i = 0; i != len; i++) {
-				m.memory.template write<uint8_t> (dst + i, 
-					m.memory.template read<uint8_t> (src + i));
-			}
-		} else {
-			while (len-- != 0) {
-				m.memory.template write<uint8_t> (dst + len, 
-					m.memory.template read<uint8_t> (src + len));
-			}
-		}
+		m.memory.move(dst, src, len);
 		m.cpu.increment_counter(2 * len);
 		return dst;
 	});
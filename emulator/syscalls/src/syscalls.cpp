@@ -15,6 +15,12 @@ struct iovec32 {
     uint32_t iov_base;
     int32_t  iov_len;
 };
+static_assert(sizeof(Memory<4>::vBuffer) == sizeof(struct iovec)
+	&& offsetof(Memory<4>::vBuffer, len) == offsetof(struct iovec, iov_len),
+	"vBuffers are passed to writev() as they are");
+// larger writes are partial writes, so that a write never needs
+// more buffers than the host takes in one writev()
+static constexpr size_t WRITE_MAX = 1u << 20;
 
 template <int W>
 long syscall_exit(Machine<W>& machine)
@@ -35,12 +41,12 @@ long syscall_write(Machine<W>& machine)
 	auto* state = machine.template get_userdata<State<W>> ();
 	// we only accept standard pipes, for now :)
 	if (fd >= 0 && fd < 3) {
-		char buffer[1024];
-		const size_t len_g = std::min(sizeof(buffer), len);
-		machine.memory.memcpy_out(buffer, address, len_g);
-		state->output += std::string(buffer, len_g);
+		const size_t len_g = std::min(WRITE_MAX, len);
+		const auto buffers = machine.memory.gather(address, len_g);
+		for (const auto& buf : buffers)
+			state->output.append((const char*) buf.ptr, buf.len);
 #ifdef RISCV_DEBUG
-		return write(fd, buffer, len);
+		return writev(fd, (const struct iovec*) buffers.data(), buffers.size());
 #else
 		return len_g;
 #endif
@@ -66,16 +72,17 @@ long syscall_writev(Machine<W>& machine)
         std::vector<iovec32> vec(count);
         machine.memory.memcpy_out(vec.data(), iov_g, size);
 
-        int res = 0;
+        long res = 0;
         for (const auto& iov : vec)
         {
-			char buffer[1024];
-            auto src_g = (uint32_t) iov.iov_base;
-            auto len_g = std::min(sizeof(buffer), (size_t) iov.iov_len);
-            machine.memory.memcpy_out(buffer, src_g, len_g);
-			state->output += std::string(buffer, len_g);
+			if (iov.iov_len < 0) return -EINVAL;
+			const size_t len_g = std::min(WRITE_MAX, (size_t) iov.iov_len);
+			const auto buffers =
+				machine.memory.gather(iov.iov_base, len_g);
+			for (const auto& buf : buffers)
+				state->output.append((const char*) buf.ptr, buf.len);
 #ifdef RISCV_DEBUG
-			res += write(fd, buffer, len_g);
+			res += writev(fd, (const struct iovec*) buffers.data(), buffers.size());
 #else
 			res += len_g;
 #endif
@@ -247,10 +254,9 @@ inline void add_mman_syscalls(Machine<W>& machine)
 	    {
 	        static uint32_t nextfree = heap_start;
 	        const uint32_t addr = nextfree;
-			// anon pages need to be zeroed
+			// anon pages need to be zeroed, which leaves them CoW
 			if (flags & MAP_ANONYMOUS) {
-				// ... but they are already CoW
-				//machine.memory.memset(addr, 0, length);
+				machine.memory.zero_range(addr, length);
 			}
 	        nextfree += length;
 	        return addr;
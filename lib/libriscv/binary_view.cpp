@@ -0,0 +1,41 @@
+#include "binary_view.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace riscv
+{
+	BinaryView BinaryView::map_file(const std::string& filename)
+	{
+		const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) throw std::runtime_error("Could not open file: " + filename);
+		try {
+			auto result = map_file(fd);
+			close(fd);
+			return result;
+		} catch (...) {
+			close(fd);
+			throw;
+		}
+	}
+
+	BinaryView BinaryView::map_file(int fd)
+	{
+		struct stat st;
+		if (fstat(fd, &st) < 0) throw std::runtime_error("Could not stat file");
+		const size_t size = st.st_size;
+		if (size == 0) return {};
+		void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) throw std::runtime_error("Could not map file");
+		std::shared_ptr<const void> mapping { data,
+			[size] (const void* ptr) { munmap((void*) ptr, size); } };
+		return { (const uint8_t*) data, size, std::move(mapping) };
+	}
+
+	BinaryView BinaryView::adopt(std::vector<uint8_t> vec)
+	{
+		auto owner = std::make_shared<const std::vector<uint8_t>> (std::move(vec));
+		return { owner->data(), owner->size(), owner };
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace riscv
+{
+	// The bytes of a program. A view of a vector does not keep the vector
+	// alive, so it has to outlive the machines. A view with an owner, eg.
+	// a mapped file, keeps the bytes alive and unchanged, and the machines
+	// use its read-only segments as guest pages without copying them.
+	struct BinaryView
+	{
+		BinaryView() = default;
+		BinaryView(const std::vector<uint8_t>& vec) noexcept
+			: m_data(vec.data()), m_size(vec.size()) {}
+		BinaryView(const uint8_t* data, size_t size,
+			std::shared_ptr<const void> owner = nullptr) noexcept
+			: m_data(data), m_size(size), m_owner(std::move(owner)) {}
+
+		// maps the whole file read-only (the descriptor can be closed after)
+		static BinaryView map_file(const std::string& filename);
+		static BinaryView map_file(int fd);
+		// takes the vector, and keeps it alive
+		static BinaryView adopt(std::vector<uint8_t> vec);
+
+		const uint8_t* data() const noexcept { return m_data; }
+		size_t size() const noexcept { return m_size; }
+		bool empty() const noexcept { return m_size == 0; }
+		const uint8_t* begin() const noexcept { return m_data; }
+		const uint8_t* end() const noexcept { return m_data + m_size; }
+		const uint8_t& at(size_t index) const {
+			if (index >= m_size) throw std::out_of_range("Outside of the binary");
+			return m_data[index];
+		}
+		const auto& owner() const noexcept { return m_owner; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		std::shared_ptr<const void> m_owner = nullptr;
+	};
+}
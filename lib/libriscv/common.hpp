@@ -22,10 +22,10 @@
 #define RISCV_SYSCALLS_MAX   512
 #endif
 
-#ifndef RISCV_MEMORY_TRAPS_ENABLED
-# ifdef RISCV_DEBUG
-#  define RISCV_MEMORY_TRAPS_ENABLED
-# endif
+// trapped pages are never in the read and write caches, nor accessible
+// in flat memory, so only the slow paths of accesses check for traps
+#if !defined(RISCV_MEMORY_TRAPS_ENABLED) && !defined(RISCV_DISABLE_MEMORY_TRAPS)
+# define RISCV_MEMORY_TRAPS_ENABLED
 #endif
 
 namespace riscv
@@ -76,6 +76,17 @@ namespace riscv
 #else
 	static constexpr bool floating_point_enabled = false;
 #endif
+#ifdef RISCV_FLAT_MEMORY
+	static constexpr bool flat_memory_enabled = true;
+#else
+	static constexpr bool flat_memory_enabled = false;
+#endif
+	// without the instruction counter there are no instruction limits
+#ifdef RISCV_DISABLE_COUNTER
+	static constexpr bool counter_enabled = false;
+#else
+	static constexpr bool counter_enabled = true;
+#endif
 
 	struct Page;
 
@@ -84,10 +95,17 @@ namespace riscv
 		uint64_t memory_max = 16ull << 20; // 16mb
 		bool load_program = true;
 		bool protect_segments = true;
+		// the decoder caches of executable pages are evicted when
+		// they would grow beyond this (with RISCV_INSTR_CACHE), and
+		// they take twice the size of the code they decode
+		uint64_t decoder_cache_max = 8ull << 20; // 8mb
+		// a shared object made from the program by rvtranslate, which
+		// is ignored unless built with RISCV_BINARY_TRANSLATION
+		std::string translation {};
 		// The pages provided will be inserted into the machine.
 		// They must be shared because there is no good way to handle
 		// machine resets (you will lose all non-shared pages).
-		std::vector<Page*> pages;
+		std::vector<Page*> pages {};
 	};
 
 	template <int W>
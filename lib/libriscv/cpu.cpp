@@ -15,21 +15,40 @@ namespace riscv
 	{
 		this->m_regs = {};
 		this->reset_stack_pointer();
+		this->reset_page_cache();
+		// jumping causes some extra calculations
+		this->jump(machine().memory.start_address());
+	}
+
+	template <int W>
+	void CPU<W>::reset_page_cache() noexcept
+	{
 #ifdef RISCV_PAGE_CACHE
 		// invalidate the page cache
 		for (auto& cache : this->m_page_cache)
-			cache.pageno = -1;
+			cache = {};
 #endif
 		this->m_current_page = {};
-		// jumping causes some extra calculations
-		this->jump(machine().memory.start_address());
 	}
 
+#ifdef RISCV_BINARY_TRANSLATION
+	template <int W>
+	bool CPU<W>::load_translation(const std::string& filename)
+	{
+		return m_translation.load(machine().memory, filename);
+	}
+#endif
+
 	template <int W> __attribute__((hot))
 	typename CPU<W>::format_t CPU<W>::read_next_instruction()
 	{
 		format_t instruction;
 #ifndef RISCV_DEBUG
+		const auto& exec = machine().memory.exec_segment();
+		if (LIKELY(exec.contains(this->pc()))) {
+			instruction.whole = exec.template read<uint32_t> (this->pc());
+			return instruction;
+		}
 		const int this_page = this->pc() >> Page::SHIFT;
 		if (this_page != this->m_current_page.pageno) {
 			this->change_page(this_page);
@@ -106,26 +125,12 @@ namespace riscv
 
 		// execute instruction
 		handler.handler(*this, instruction);
-#else
-#ifdef RISCV_INSTR_CACHE
-		// retrieve cached instruction
-		const address_t offset  = this->pc() & (Page::size()-1);
-
-		auto* dcache = m_current_page.page->decoder_cache();
-		auto& ihandler = dcache->cache32[offset / DecoderCache<Page::SIZE>::DIVISOR];
-		// decode and store into cache, if necessary
-		if (UNLIKELY(!ihandler)) {
-			ihandler = this->decode(instruction).handler;
-		}
-		// execute instruction
-		ihandler(*this, instruction);
 #else
 		// decode & execute instruction directly
 		this->execute(instruction);
-#endif
 #endif
 		// increment instruction counter
-		this->m_counter++;
+		this->increment_counter(1);
 
 #ifdef RISCV_DEBUG
 		if (UNLIKELY(machine().verbose_registers))
@@ -150,6 +155,202 @@ namespace riscv
 			registers().pc += 4;
 	}
 
+#ifndef RISCV_INSTR_CACHE
+	template<int W> __attribute__((hot))
+	void CPU<W>::simulate_block(const uint64_t max_counter)
+	{
+		// instructions are counted in bulk, and the block ends at the first
+		// taken jump or system instruction, which is when the machine checks
+		// the instruction limit and whether it was stopped
+		const uint64_t budget = max_counter - m_counter;
+		uint64_t count = 0;
+		try {
+			while (!counter_enabled || count < budget)
+			{
+				const auto instruction = this->read_next_instruction();
+				const unsigned length = (compressed_enabled) ? instruction.length() : 4;
+				// system calls can read the instruction counter
+				if (UNLIKELY(instruction.opcode() == 0b1110011
+					|| (compressed_enabled && instruction.half[0] == 0x9002))) // C.EBREAK
+				{
+					this->increment_counter(count);
+					count = 0;
+					this->execute(instruction);
+					this->increment_counter(1);
+					registers().pc += length;
+					return;
+				}
+				const address_t next_pc = this->pc() + length;
+				this->execute(instruction);
+				count++;
+				registers().pc += length;
+				if (UNLIKELY(this->pc() != next_pc)) break;
+			}
+		} catch (...) {
+			// the faulting instruction did not complete
+			this->increment_counter(count);
+			throw;
+		}
+		this->increment_counter(count);
+	}
+#endif
+
+#ifdef RISCV_INSTR_CACHE
+	template<int W>
+	unsigned CPU<W>::decode_block(const CodeView& view)
+	{
+		constexpr size_t DIVISOR = DecoderCache<Page::SIZE>::DIVISOR;
+		auto* cache = view.cache;
+		const address_t offset = view.offset;
+		// decode forwards until we reach a branching instruction,
+		// the end of the code view or an already decoded instruction
+		constexpr unsigned BLOCK_MAX = DecoderEntry<W>::BLOCK_MAX;
+		unsigned count = 0;
+		unsigned instructions = 0;
+		unsigned tail  = 0;
+		address_t pos  = offset;
+		while (pos < view.size && instructions < BLOCK_MAX - 1)
+		{
+			auto& entry = cache[pos / DIVISOR];
+			if (entry.handler != 0) {
+				// join the decoded block, unless it gets too long
+				if (instructions + entry.block_length <= BLOCK_MAX)
+					tail = entry.block_length;
+				break;
+			}
+			format_t instruction;
+			if (LIKELY(pos <= view.size - 4)) {
+				instruction.whole = *(uint32_t*) &view.code[pos];
+			} else {
+				instruction.whole = *(uint16_t*) &view.code[pos];
+				// crossing out of the code view, must be single-stepped
+				if (instruction.is_long()) break;
+			}
+			unsigned length = (compressed_enabled) ? instruction.length() : 4;
+			// try to fuse with the next instruction, which keeps its own
+			// (lazily decoded) entry, in case something jumps straight to it
+			format_t second;
+			if (pos + 8 <= view.size) {
+				second.whole = *(uint32_t*) &view.code[pos + 4];
+			} else if (compressed_enabled && pos + 6 <= view.size) {
+				second.whole = *(uint16_t*) &view.code[pos + 4];
+				if (second.is_long()) second.whole = 0;
+			}
+			uint32_t fused_bits;
+			const uint8_t fused = (length == 4)
+				? isa_t::fuse(instruction, second, fused_bits) : 0;
+			if (fused != 0) {
+				entry.handler = isa_t::handler_index(fused);
+				length += (compressed_enabled) ? second.length() : 4;
+				instruction = second;
+				instructions += 2;
+			} else {
+				entry.handler = isa_t::handler_index(instruction);
+				instructions += 1;
+			}
+			entry.length = length;
+			count++;
+			pos += length;
+			if (isa_t::is_block_end(instruction)) break;
+		}
+		// each instruction knows how many instructions are left in the block
+		pos = offset;
+		instructions += tail;
+		for (unsigned i = 0; i < count; i++)
+		{
+			auto& entry = cache[pos / DIVISOR];
+			entry.block_length = instructions;
+			instructions -= entry.instructions();
+			pos += entry.length;
+		}
+		return count;
+	}
+
+	template <int W> __attribute__((hot))
+	typename CPU<W>::format_t CPU<W>::cached_instruction(const uint8_t* code, unsigned length)
+	{
+		format_t instruction;
+		if (length == 4) {
+			std::memcpy(&instruction.whole, code, 4);
+		} else if (length == 2) {
+			uint16_t half;
+			std::memcpy(&half, code, 2);
+			instruction.whole = half;
+		} else {
+			instruction.whole = isa_t::fused_operands(code, length);
+		}
+		return instruction;
+	}
+
+	template <int W>
+	void CPU<W>::decode_execute_segment()
+	{
+		constexpr size_t DIVISOR = DecoderCache<Page::SIZE>::DIVISOR;
+		const auto& exec = machine().memory.exec_segment();
+		if (exec.decoder_cache == nullptr) return;
+		auto* cache = exec.decoder_cache.get();
+		// every block that could be jumped to, in the order of the code
+		for (address_t offset = 0; offset < exec.size; offset += DIVISOR) {
+			if (cache[offset / DIVISOR].handler == 0)
+				this->decode_block({ cache, exec.data.get(), exec.size, offset });
+		}
+	}
+#endif
+
+#if defined(RISCV_INSTR_CACHE) && !defined(RISCV_THREADED)
+	template<int W> __attribute__((hot))
+	void CPU<W>::simulate_block(const uint64_t max_counter)
+	{
+#ifdef RISCV_BINARY_TRANSLATION
+		if (m_translation.simulate(*this, max_counter)) return;
+#endif
+#ifdef RISCV_JIT
+		if (m_jit.simulate(*this, max_counter)) return;
+#endif
+		constexpr size_t DIVISOR = DecoderCache<Page::SIZE>::DIVISOR;
+		const auto view = this->code_view();
+		const auto* entry = &view.cache[view.offset / DIVISOR];
+		const uint8_t* code = &view.code[view.offset];
+		if (UNLIKELY(entry->handler == 0)) {
+			this->decode_block(view);
+		}
+		// instructions that cross out of the code view are never cached,
+		// and near the instruction limit we single-step without fusing
+		if (UNLIKELY(entry->handler == 0
+			|| entry->block_length > max_counter - m_counter)) {
+			this->simulate();
+			return;
+		}
+		// the branch at the end of the block can read the instruction
+		// counter (eg. system calls), and should see the exact value
+		unsigned remaining = entry->block_length;
+		this->increment_counter(remaining - 1);
+		try {
+			do {
+				// the handler could be a system call that
+				// destroys the cache, so copy everything
+				const auto handler = isa_t::handlers[entry->handler];
+				const unsigned length = entry->length;
+				const unsigned instructions = entry->instructions();
+				const auto instruction = cached_instruction(code, length);
+				entry += length / DIVISOR;
+				code  += length;
+
+				handler(*this, instruction);
+				registers().pc += length;
+				remaining -= instructions;
+			} while (remaining != 0);
+		} catch (...) {
+			// the faulting instruction did not complete, and a fused
+			// handler counts the first half of its pair on its own
+			if constexpr (counter_enabled)
+				this->m_counter -= remaining - 1;
+			throw;
+		}
+		this->increment_counter(1);
+	}
+#endif
+
 	template<int W> __attribute__((cold))
 	void CPU<W>::trigger_exception(interrupt_t intr)
 	{
@@ -5,6 +5,12 @@
 #include "rv32i.hpp"
 #include "rv64i.hpp"
 #include "rv32a.hpp"
+#ifdef RISCV_JIT
+#include "jit.hpp"
+#endif
+#ifdef RISCV_BINARY_TRANSLATION
+#include "translation.hpp"
+#endif
 #include "util/function.hpp"
 #include <map>
 #include <vector>
@@ -23,14 +29,24 @@ namespace riscv
 		using instruction_t = Instruction<W>;
 
 		void simulate();
+		// executes one straight-line block of instructions, stopping
+		// early if the instruction counter reaches @max_counter
+		void simulate_block(uint64_t max_counter);
 		void reset();
 		void reset_stack_pointer() noexcept;
+#ifdef RISCV_BINARY_TRANSLATION
+		// executes blocks from a shared object made by rvtranslate,
+		// returns false when it was not made from the current program
+		bool load_translation(const std::string& filename);
+#endif
 
 		address_t pc() const noexcept { return registers().pc; }
 		constexpr void jump(address_t);
 
 		uint64_t instruction_counter() const noexcept { return m_counter; }
-		void     increment_counter(uint64_t val) noexcept { m_counter += val; }
+		void     increment_counter(uint64_t val) noexcept {
+			if constexpr (counter_enabled) m_counter += val;
+		}
 		void     reset_instruction_counter() noexcept { m_counter = 0; }
 #ifdef RISCV_PAGE_CACHE
 		int64_t  page_cache_evictions() const noexcept { return std::max((int64_t) 0, m_cache_iterator - (int64_t) m_page_cache.size()); }
@@ -67,19 +83,54 @@ namespace riscv
 		void serialize_to(std::vector<uint8_t>& vec);
 		// returns the machine to a previously stored state
 		void deserialize_from(const std::vector<uint8_t>&, const SerializedMachine<W>&);
+#ifdef RISCV_INSTR_CACHE
+		// decodes every instruction of the execute segment, after
+		// which its decoder cache is only ever read from
+		void decode_execute_segment();
+#endif
+		// returns to @regs, forgetting about any cached pages
+		void restore_registers(const Registers<W>&);
+		// forgets the instruction pages, eg. when they are replaced
+		void reset_page_cache() noexcept;
 
 		CPU(Machine<W>&);
+		// continues from the state of @other, see Machine::fork()
+		CPU(Machine<W>&, const CPU& other);
 	private:
 		Registers<W> m_regs;
 		uint64_t     m_counter = 0;
 
 		inline format_t read_next_instruction();
 		void execute(format_t);
+#ifdef RISCV_INSTR_CACHE
+		// the decoder cache and the code around PC, taken from
+		// the execute segment when possible, or the current page
+		struct CodeView {
+			DecoderEntry<W>* cache;
+			const uint8_t*   code;
+			address_t        size;
+			address_t        offset;
+		};
+		inline CodeView code_view();
+		// the instruction bits of a decoded entry of @length bytes at @code
+		static format_t cached_instruction(const uint8_t* code, unsigned length);
+		// returns the number of (possibly fused) instructions decoded
+		unsigned decode_block(const CodeView&);
+#endif
+
+#ifdef RISCV_BINARY_TRANSLATION
+		Translation<W> m_translation;
+#endif
+#ifdef RISCV_JIT
+		Jit<W> m_jit;
+#endif
 
 		Machine<W>& m_machine;
 		struct CachedPage {
+			// page numbers are ints, so no address is on this page
+			static constexpr int64_t NO_PAGE = INT64_MIN;
 			Page*   page = nullptr;
-			int64_t pageno = 0;
+			int64_t pageno = NO_PAGE;
 		};
 		CachedPage m_current_page;
 #ifdef RISCV_PAGE_CACHE
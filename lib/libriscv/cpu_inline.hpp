@@ -5,6 +5,21 @@ inline CPU<W>::CPU(Machine<W>& machine)
 {
 }
 template <int W>
+inline CPU<W>::CPU(Machine<W>& machine, const CPU& other)
+	: m_regs { other.m_regs },
+	  m_counter { other.m_counter },
+#ifdef RISCV_BINARY_TRANSLATION
+	  m_translation { other.m_translation },
+#endif
+	  m_machine { machine }
+{
+#ifdef RISCV_DEBUG
+	this->m_breakpoints = other.m_breakpoints;
+#endif
+	// the pages of the parent are not the pages of this machine
+	this->reset_page_cache();
+}
+template <int W>
 inline void CPU<W>::reset_stack_pointer() noexcept
 {
 	// initial stack location
@@ -40,10 +55,112 @@ if constexpr (execute_traps_enabled) {
 	}
 #ifdef RISCV_INSTR_CACHE
 	if (UNLIKELY(m_current_page.page->decoder_cache() == nullptr)) {
-		m_current_page.page->create_decoder_cache();
+		if (m_current_page.page->attr.shared) {
+			// other machines execute from shared pages too,
+			// so this machine decodes its own copy instead
+			auto& copy = machine().memory.create_page(pageno);
+			m_current_page = { &copy, pageno };
+#ifdef RISCV_PAGE_CACHE
+			m_page_cache[m_cache_iterator % m_page_cache.size()] = m_current_page;
+			m_cache_iterator ++;
+#endif
+		}
+		machine().memory.create_decoder_cache(*m_current_page.page);
+	}
+#endif
+}
+
+#ifdef RISCV_INSTR_CACHE
+template <int W> __attribute__((hot))
+inline typename CPU<W>::CodeView CPU<W>::code_view()
+{
+	const auto& exec = machine().memory.exec_segment();
+	if (LIKELY(exec.contains(this->pc()) && exec.decoder_cache != nullptr)) {
+		return { exec.decoder_cache.get(), exec.data.get(),
+				exec.size, this->pc() - exec.begin };
+	}
+	const int this_page = this->pc() >> Page::SHIFT;
+	auto* page = m_current_page.page;
+	// pages lose their decoder cache when they are no longer executable
+	if (this_page != this->m_current_page.pageno
+		|| UNLIKELY(page == nullptr || page->decoder_cache() == nullptr)) {
+		this->change_page(this_page);
+		page = m_current_page.page;
+	}
+	auto* cache = page->decoder_cache();
+	if (UNLIKELY(cache->stale_end != 0)) {
+		cache->template clear_stale<W>();
 	}
+	return { cache->template get<W>().data(), page->data(),
+			Page::size(), this->pc() & (address_t) (Page::size()-1) };
+}
 #endif
+
+#ifdef RISCV_BINARY_TRANSLATION
+template <int W> __attribute__((hot))
+inline bool Translation<W>::simulate(CPU<W>& cpu, const uint64_t max_counter)
+{
+	const auto& exec = cpu.machine().memory.exec_segment();
+	const address_t pc = cpu.pc();
+	const size_t index = (pc - m_begin) / DIVISOR;
+	if (index >= m_blocks.size() || m_blocks[index] == nullptr
+		|| !exec.contains(pc)) return false;
+	const auto& block = *m_blocks[index];
+	// near the instruction limit the interpreter takes over
+	if (UNLIKELY(block.instructions > max_counter - cpu.instruction_counter())) {
+		return false;
+	}
+	m_state.cpu = &cpu;
+	const uint32_t done = block.function(&cpu.reg(0), m_api, &m_state);
+	cpu.increment_counter(done);
+	if (UNLIKELY(m_state.faulted)) {
+		m_state.faulted = false;
+		std::rethrow_exception(std::move(m_state.exception));
+	}
+	return block.complete && done == block.instructions;
+}
+#endif
+
+#ifdef RISCV_JIT
+template <int W> __attribute__((hot))
+inline bool Jit<W>::simulate(CPU<W>& cpu, const uint64_t max_counter)
+{
+	const auto& exec = cpu.machine().memory.exec_segment();
+	const address_t pc = cpu.pc();
+	// only the execute segment is translated, as it never changes
+	if (!exec.contains(pc) || UNLIKELY(m_disabled)) return false;
+	if (UNLIKELY(m_segment != exec.data.get())) {
+		this->reset();
+		m_segment = exec.data.get();
+	}
+	if (UNLIKELY(m_slots == nullptr)) {
+		m_slots.reset(new Slot[SLOTS] {});
+	}
+	auto& slot = m_slots[(pc >> 1) % SLOTS];
+	if (slot.pc != pc) {
+		slot = { pc, 1, 0, false, nullptr };
+		return false;
+	}
+	if (slot.native == nullptr) {
+		if (++slot.count != HOT_BLOCK) return false;
+		if (this->translate(cpu, pc, slot) == nullptr) return false;
+	}
+	// near the instruction limit the interpreter takes over
+	const unsigned instructions = slot.instructions;
+	if (UNLIKELY(instructions > max_counter - cpu.instruction_counter())) {
+		return false;
+	}
+	const bool complete = slot.complete;
+	m_state.cpu = &cpu;
+	const uint32_t done = slot.native(&cpu.reg(0), &m_state);
+	cpu.increment_counter(done);
+	if (UNLIKELY(m_state.faulted)) {
+		m_state.faulted = false;
+		std::rethrow_exception(std::move(m_state.exception));
+	}
+	return complete && done == instructions;
 }
+#endif
 
 template <int W> __attribute__((hot))
 inline void CPU<W>::check_page(CachedPage& cp)
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <array>
 #include "types.hpp"
 #include "rv32i.hpp"
@@ -6,11 +7,29 @@
 
 namespace riscv {
 
+template <int W>
+struct DecoderEntry
+{
+	// the longest straight-line block, in instructions
+	static constexpr unsigned BLOCK_MAX = 255;
+
+	// index into the handler table of the ISA, or zero when not decoded.
+	// The instruction bits are read from the code again when executing,
+	// as keeping them here would double the size of the cache.
+	uint16_t  handler;
+	// number of instructions from this one until the end of
+	// its straight-line block, including the branch at the end
+	uint8_t   block_length;
+	uint8_t   length; // in bytes, both instructions when fused
+
+	// fused pairs always start with a 32-bit instruction
+	unsigned instructions() const noexcept { return (length > 4) ? 2 : 1; }
+};
+static_assert(sizeof(DecoderEntry<4>) == 4, "Decoder entries should stay compact");
+
 template <size_t PageSize>
-union DecoderCache
+struct DecoderCache
 {
-	using handler32 = Instruction<4>::handler_t;
-	using handler64 = Instruction<8>::handler_t;
 #ifdef RISCV_EXT_COMPRESSED
 	// we are making room for the maximum amount of
 	// compressed instructions, which are 16-bits
@@ -20,8 +39,31 @@ union DecoderCache
 	static constexpr size_t DIVISOR = 4;
 #endif
 
-	std::array<handler32, PageSize / DIVISOR> cache32 = {nullptr};
-	std::array<handler64, PageSize / DIVISOR> cache64;
-};
+	template <int W>
+	auto& get() noexcept {
+		if constexpr (W == 4) return cache32;
+		else return cache64;
+	}
 
+	// the page was written to before @end, which invalidates every
+	// block that starts there, as blocks only ever run forwards
+	void invalidate(size_t end) noexcept {
+		if (end > stale_end) stale_end = end;
+	}
+	// the stale entries are cleared lazily, before the next block
+	// starts, as the current block may still be running from them
+	template <int W>
+	void clear_stale() noexcept {
+		auto& cache = get<W>();
+		std::fill(cache.begin(), cache.begin() + (stale_end + DIVISOR-1) / DIVISOR,
+			DecoderEntry<W> {});
+		stale_end = 0;
+	}
+
+	union {
+		std::array<DecoderEntry<4>, PageSize / DIVISOR> cache32 = {};
+		std::array<DecoderEntry<8>, PageSize / DIVISOR> cache64;
+	};
+	size_t stale_end = 0;
+};
 }
@@ -0,0 +1,61 @@
+#include "flat_arena.hpp"
+#include "common.hpp"
+#include "types.hpp"
+#include <cstring>
+#include <sys/mman.h>
+
+namespace riscv
+{
+	static constexpr size_t ACCESS_SIZE = FlatArena::PAGES + 1;
+
+	FlatArena::FlatArena()
+	{
+		this->m_host = (uint8_t*) mmap(nullptr, SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		this->m_access = (uint8_t*) mmap(nullptr, ACCESS_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (m_host == MAP_FAILED || m_access == MAP_FAILED) {
+			if (m_host == MAP_FAILED) m_host = nullptr;
+			if (m_access == MAP_FAILED) m_access = nullptr;
+			this->release();
+			throw MachineException(OUT_OF_MEMORY, "Could not reserve flat memory");
+		}
+		this->protect(0, SIZE, true, false);
+	}
+
+	FlatArena::FlatArena(const FlatArena&) : FlatArena()
+	{
+		this->protect(0, SIZE, false, false);
+	}
+
+	FlatArena::~FlatArena()
+	{
+		this->release();
+	}
+
+	void FlatArena::release() noexcept
+	{
+		if (m_host)   munmap(m_host, SIZE);
+		if (m_access) munmap(m_access, ACCESS_SIZE);
+		this->m_host   = nullptr;
+		this->m_access = nullptr;
+	}
+
+	void FlatArena::protect(uint64_t addr, size_t len, bool read, bool write)
+	{
+		const uint8_t access = (read ? READ : 0) | (write ? WRITE : 0);
+		std::memset(&m_access[addr >> Page::SHIFT], access, len >> Page::SHIFT);
+	}
+
+	void FlatArena::discard(uint64_t addr, size_t len)
+	{
+		// private anonymous memory reads as zeroes afterwards
+		madvise(&m_host[addr], len, MADV_DONTNEED);
+	}
+
+	void FlatArena::reset()
+	{
+		this->discard(0, SIZE);
+		this->protect(0, SIZE, true, false);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "page.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace riscv
+{
+	// The whole 32-bit address space of a machine, as one host mapping
+	// that the page data is in. Memory::read and write access it directly
+	// when a table with a byte per page allows it, so guest accesses never
+	// fault, and take the slow path otherwise. Untouched memory is zeroes.
+	struct FlatArena
+	{
+		static constexpr uint64_t SIZE  = 1ull << 32;
+		static constexpr uint64_t PAGES = SIZE >> Page::SHIFT;
+		enum : uint8_t { READ = 1, WRITE = 2 };
+
+		uint8_t* host() const noexcept { return m_host; }
+		bool owns(const uint8_t* data) const noexcept {
+			return (uintptr_t) data - (uintptr_t) m_host < SIZE;
+		}
+		// true when both ends of the access are on pages that allow it
+		bool allows(uint32_t addr, size_t len, uint8_t access) const noexcept {
+			return (m_access[addr >> Page::SHIFT]
+				& m_access[(addr + len - 1) >> Page::SHIFT] & access) != 0;
+		}
+
+		void protect(uint64_t addr, size_t len, bool read, bool write);
+		// zeroes the range, giving the memory back to the system
+		void discard(uint64_t addr, size_t len);
+		// discards everything, and makes all of the memory read-only
+		void reset();
+
+		FlatArena();
+		// the pages of a copied machine are still the originals, so the
+		// new arena starts out inaccessible, until the next reset
+		FlatArena(const FlatArena&);
+		FlatArena& operator= (const FlatArena&) = delete;
+		~FlatArena();
+	private:
+		void release() noexcept;
+
+		uint8_t* m_host   = nullptr;
+		// one more page, for accesses that cross the end
+		uint8_t* m_access = nullptr;
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "types.hpp"
+#include <memory>
+
+namespace riscv
+{
+	// Second tier for the decoder cache: straight-line blocks in the
+	// execute segment are counted as they are dispatched, and the hot
+	// ones are translated to x86-64 code, which works directly on the
+	// guest registers. Native code stops (deopts) wherever the interpreter
+	// has to take over, so the instruction counter stays exact.
+	template <int W>
+	struct Jit
+	{
+		using address_t = address_type<W>;
+		static constexpr unsigned HOT_BLOCK  = 64;   // dispatches before translating
+		static constexpr size_t   SLOTS      = 4096; // direct-mapped by PC
+		static constexpr size_t   ARENA_SIZE = 2ull << 20;
+
+		// shared between native code and the handlers it calls
+		struct State {
+			bool faulted = false; // must be first, tested by native code
+			CPU<W>* cpu = nullptr;
+			std::exception_ptr exception = nullptr;
+
+			void fail() noexcept {
+				this->faulted = true;
+				this->exception = std::current_exception();
+			}
+		};
+		// returns the number of instructions completed, with PC
+		// pointing to the next instruction
+		using native_t = uint32_t (*)(void* regs, State*);
+
+		// runs the native code for the block at PC, if it is hot enough,
+		// and returns true when the whole block has been executed
+		inline bool simulate(CPU<W>&, uint64_t max_counter);
+		// forget all native code
+		void reset() noexcept;
+
+		Jit() = default;
+		// native code belongs to one machine, and is never copied
+		Jit(const Jit&) : Jit() {}
+		Jit& operator= (const Jit&) = delete;
+		~Jit();
+	private:
+		struct Slot {
+			address_t pc;
+			uint16_t  count;
+			uint8_t   instructions;
+			bool      complete; // the block ended with a translated branch
+			native_t  native;
+		};
+		native_t translate(CPU<W>&, address_t pc, Slot&);
+
+		std::unique_ptr<Slot[]> m_slots = nullptr;
+		uint8_t* m_arena = nullptr;
+		size_t   m_arena_used = 0;
+		bool     m_disabled = false;
+		// the execute segment the native code was translated from
+		const uint8_t* m_segment = nullptr;
+		State    m_state;
+	};
+
+	// only RV32 is translated (see rv32i_jit.cpp)
+	template <> Jit<4>::native_t Jit<4>::translate(CPU<4>&, address_t, Slot&);
+	template <> void Jit<4>::reset() noexcept;
+	template <> Jit<4>::~Jit();
+}
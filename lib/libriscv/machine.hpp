@@ -16,13 +16,24 @@ namespace riscv
 		using syscall_t = Function<long(Machine&)>;
 		using address_t = address_type<W>; // one unsigned memory address
 
-		// see common.hpp for MachineOptions
-		Machine(const std::vector<uint8_t>& binary,
-				MachineOptions);
-		Machine(const std::vector<uint8_t>& binary,
+		// see common.hpp for MachineOptions. The binary must outlive the
+		// machine, unless it owns its bytes (see binary_view.hpp), which
+		// is how BinaryView::map_file() loads a program without copying.
+		Machine(BinaryView binary, MachineOptions);
+		Machine(BinaryView binary,
 				uint64_t memory_max = 16ull << 20 /* 16mb */);
+		// A machine for a program that was loaded once, and is shared
+		// by every machine made from it (see program_image.hpp).
+		Machine(std::shared_ptr<const ProgramImage<W>>, MachineOptions = {});
 		~Machine();
 
+		// Creates a machine that continues from the current state of
+		// this one, eg. stopped at main(). All pages become shared
+		// between the two, and are copied when either writes to one.
+		// Syscall handlers and userdata are kept, and the binary must
+		// outlive every fork. Not available with flat memory.
+		std::unique_ptr<Machine> fork();
+
 		// Simulate a RISC-V machine until @max_instructions have been
 		// executed, or the machine has been stopped.
 		// NOTE: if @max_instructions is 0, then run until stop
@@ -127,13 +138,22 @@ namespace riscv
 		// destructor callbacks are kept. Page fault handler and
 		// symbol lookup cache is also kept. Returns 0 on success.
 		int deserialize_from(const std::vector<uint8_t>&);
+		// Remembers the current state of the machine. Memory then keeps
+		// track of the pages that change, so that restore_checkpoint()
+		// only has to undo those. The checkpoint is kept after restoring,
+		// and it is lost on reset() and deserialize_from().
+		void checkpoint();
+		void restore_checkpoint();
 
 	private:
+		struct ForkTag {};
+		Machine(Machine& parent, ForkTag);
 		template<typename... Args, std::size_t... indices>
 		auto resolve_args(std::index_sequence<indices...>) const;
 		bool m_stopped = false;
 		std::array<syscall_t, RISCV_SYSCALLS_MAX> m_syscall_handlers;
 		std::vector<Function<void()>> m_destructor_callbacks;
+		std::shared_ptr<const Registers<W>> m_checkpoint = nullptr;
 		void* m_userdata = nullptr;
 		static_assert((W == 4 || W == 8), "Must be either 4-byte or 8-byte ISA");
 	};
@@ -1,15 +1,47 @@
 
 template <int W>
-inline Machine<W>::Machine(const std::vector<uint8_t>& binary, 
+inline Machine<W>::Machine(BinaryView binary,
 							MachineOptions options)
-	: cpu(*this), memory(*this, binary, options)
+	: cpu(*this), memory(*this, std::move(binary), options)
 {
 	cpu.reset();
+#ifdef RISCV_BINARY_TRANSLATION
+	if (!options.translation.empty())
+		cpu.load_translation(options.translation);
+#endif
 }
 template <int W>
-inline Machine<W>::Machine(const std::vector<uint8_t>& binary, 
+inline Machine<W>::Machine(BinaryView binary,
 							uint64_t mmax)
-	: Machine(binary, { .memory_max = mmax }) {}
+	: Machine(std::move(binary), { .memory_max = mmax }) {}
+template <int W>
+inline Machine<W>::Machine(std::shared_ptr<const ProgramImage<W>> image,
+							MachineOptions options)
+	: cpu(*this), memory(*this, std::move(image), options)
+{
+	cpu.reset();
+#ifdef RISCV_BINARY_TRANSLATION
+	if (!options.translation.empty())
+		cpu.load_translation(options.translation);
+#endif
+}
+template <int W>
+inline Machine<W>::Machine(Machine& parent, ForkTag)
+	: cpu(*this, parent.cpu), memory(*this, parent.memory),
+	  m_syscall_handlers { parent.m_syscall_handlers },
+	  m_userdata { parent.m_userdata }
+{
+}
+template <int W>
+inline std::unique_ptr<Machine<W>> Machine<W>::fork()
+{
+	if constexpr (flat_memory_enabled) {
+		// the page data is in the arena, which belongs to the machine
+		throw MachineException(ILLEGAL_OPERATION,
+			"Machines with flat memory can not be forked");
+	}
+	return std::unique_ptr<Machine> (new Machine(*this, ForkTag{}));
+}
 template <int W>
 inline Machine<W>::~Machine()
 {
@@ -30,7 +62,23 @@ template <bool Throw>
 inline void Machine<W>::simulate(uint64_t max_instr)
 {
 	this->m_stopped = false;
-	if (max_instr != 0) {
+#ifndef RISCV_DEBUG
+	// the engines count instructions in bulk, and only return to
+	// check the limit and the stopped flag at the end of a block,
+	// never executing past the limit
+	const uint64_t max_counter = (max_instr != 0 && counter_enabled) ?
+		cpu.instruction_counter() + max_instr : UINT64_MAX;
+	while (LIKELY(!this->stopped())) {
+		cpu.simulate_block(max_counter);
+		if (UNLIKELY(cpu.instruction_counter() >= max_counter)) {
+			if constexpr (Throw) {
+				throw MachineTimeoutException(MAX_INSTRUCTIONS_REACHED,
+					"Maximum instruction counter reached", max_counter);
+			} else break;
+		}
+	}
+#else
+	if (max_instr != 0 && counter_enabled) {
 		max_instr += cpu.instruction_counter();
 		while (LIKELY(!this->stopped())) {
 			cpu.simulate();
@@ -47,6 +95,7 @@ inline void Machine<W>::simulate(uint64_t max_instr)
 			cpu.simulate();
 		}
 	}
+#endif
 }
 
 template <int W>
@@ -2,6 +2,8 @@
 #include "machine.hpp"
 #include "decoder_cache.hpp"
 #include "elf.hpp"
+#include "program_image.hpp"
+#include <algorithm>
 #include <stdexcept>
 
 extern "C" char *
@@ -11,21 +13,95 @@ namespace riscv
 {
 	template <int W>
 	Memory<W>::Memory(Machine<W>& mach,
-					const std::vector<uint8_t>& bin,
+					BinaryView bin,
 					MachineOptions options)
 		: m_machine{mach},
-		  m_binary{bin},
+		  m_binary{std::move(bin)},
 		  m_load_program     {options.load_program},
 		  m_protect_segments {options.protect_segments}
 	{
+		static_assert(W == 4 || !flat_memory_enabled, "Flat memory is only for RV32");
 		assert(options.memory_max % Page::size() == 0);
 		assert(options.memory_max >= Page::size());
 		this->m_pages_total = options.memory_max / Page::size();
+#ifdef RISCV_INSTR_CACHE
+		this->m_decoder_cache_max = options.decoder_cache_max;
+#endif
 		this->reset();
 		// set the default exit function address for vm calls
 		this->m_exit_address = resolve_address("_exit");
 	}
 	template <int W>
+	Memory<W>::Memory(Machine<W>& mach,
+					std::shared_ptr<const ProgramImage<W>> image,
+					MachineOptions options)
+		: m_machine{mach},
+		  m_image{std::move(image)},
+		  m_binary{m_image->binary},
+		  m_load_program     {options.load_program},
+		  m_protect_segments {options.protect_segments}
+	{
+		assert(options.memory_max % Page::size() == 0);
+		assert(options.memory_max >= Page::size());
+		this->m_pages_total = options.memory_max / Page::size();
+#ifdef RISCV_INSTR_CACHE
+		this->m_decoder_cache_max = options.decoder_cache_max;
+#endif
+		this->reset();
+	}
+	template <int W>
+	Memory<W>::Memory(Machine<W>& mach, Memory& parent)
+		: m_machine{mach},
+		  m_page_fault_handler{parent.m_page_fault_handler},
+		  m_image{parent.m_image},
+		  m_binary{parent.m_binary},
+		  m_exec{parent.m_exec},
+		  m_start_address{parent.m_start_address},
+		  m_stack_address{parent.m_stack_address},
+		  m_exit_address {parent.m_exit_address},
+		  m_load_program     {parent.m_load_program},
+		  m_protect_segments {parent.m_protect_segments},
+		  m_pages_total      {parent.m_pages_total}
+	{
+		// every page of the parent becomes shared, and
+		// the first machine to write to a page copies it
+		auto converted = parent.convert_to_shared_memory();
+		if (!converted.empty()) {
+			auto forked = std::make_shared<SharedPages>();
+			forked->pages.reserve(converted.size());
+			for (const auto& it : converted) forked->pages.push_back(it.second);
+#ifndef RISCV_FLAT_MEMORY
+			// every page with data from the arena is among them
+			forked->arena = std::move(parent.m_arena);
+#endif
+			parent.m_shared_pages.push_back(std::move(forked));
+		}
+		this->m_shared_pages = parent.m_shared_pages;
+		this->m_devices = parent.m_devices;
+		this->m_pages  = parent.m_pages;
+		// device memory is not copied, so that both machines see every
+		// write to it, but each machine has its own pages over it
+		parent.m_pages.for_each([this] (address_t pageno, Page* page) {
+			if (page->m_device_data) {
+				auto* copy = new Page(page->page(), page->attr);
+				copy->m_device_data = true;
+				copy->copy_trap(*page);
+				m_pages.erase(pageno);
+				m_pages.insert(pageno, copy);
+			}
+		});
+		this->m_pages_highest = m_pages.size();
+#ifdef RISCV_INSTR_CACHE
+		this->m_decoder_cache_max = parent.m_decoder_cache_max;
+		// decoding writes to the cache, so each machine needs its own
+		if (m_exec.decoder_cache != nullptr) {
+			const size_t entries = m_exec.size / DecoderCache<Page::SIZE>::DIVISOR;
+			m_exec.decoder_cache.reset(new DecoderEntry<W>[entries] {});
+			m_decoder_cache_size = entries * sizeof(DecoderEntry<W>);
+		}
+#endif
+	}
+	template <int W>
 	Memory<W>::~Memory()
 	{
 		this->clear_all_pages();
@@ -38,28 +114,47 @@ namespace riscv
 		// initialize paging (which clears all pages) before loading binary
 		this->initial_paging();
 		// load ELF binary into virtual memory
-		if (!m_binary.empty())
+		if (m_image != nullptr)
+			this->image_loader();
+		else if (!m_binary.empty())
 			this->binary_loader();
 	}
 
 	template <int W>
 	void Memory<W>::clear_all_pages()
 	{
+		this->discard_checkpoint();
 		// delete any pages that aren't shared
-		for (auto it : m_pages) {
-			if (!it.second->attr.shared) delete it.second;
-		}
+		m_pages.for_each([] (address_t, Page* page) {
+			if (!page->attr.shared) delete page;
+		});
 		this->m_pages.clear();
-		this->m_current_rd_page = -1;
-		this->m_current_rd_ptr  = nullptr;
-		this->m_current_wr_page = -1;
-		this->m_current_wr_ptr  = nullptr;
+		this->m_shared_pages.clear();
+		this->m_devices.clear();
+		// the page data goes back all at once
+#ifdef RISCV_FLAT_MEMORY
+		this->m_flat.reset();
+#else
+		this->m_arena.release();
+#endif
+		this->m_exec.fetch_size = 0;
+#ifdef RISCV_INSTR_CACHE
+		this->m_decoder_cache_size = 0;
+#endif
+		this->tlb_flush();
+	}
+
+	template <int W>
+	void Memory<W>::tlb_flush() noexcept
+	{
+		m_rd_tlb.fill({});
+		m_wr_tlb.fill({});
 	}
 
 	template <int W>
 	void Memory<W>::initial_paging()
 	{
-		if (m_pages.find(0) == m_pages.end()) {
+		if (m_pages.find(0) == nullptr) {
 			// add a guard page to catch zero-page accesses
 			install_shared_page(0, Page::guard_page());
 		}
@@ -78,9 +173,6 @@ namespace riscv
 		printf("* Loading program of size %zu from %p to virtual %p\n",
 				len, src, (void*) (uintptr_t) hdr->p_vaddr);
 		}
-		// load into virtual memory
-		this->memcpy(hdr->p_vaddr, src, len);
-		// set permissions
 		const bool readable   = hdr->p_flags & PF_R;
 		const bool writable   = hdr->p_flags & PF_W;
 		const bool executable = hdr->p_flags & PF_X;
@@ -88,17 +180,176 @@ namespace riscv
 		printf("* Program segment readable: %d writable: %d  executable: %d\n",
 				readable, writable, executable);
 		}
-		if (this->m_protect_segments) {
-			this->set_page_attr(hdr->p_vaddr, len, {
-				 .read = readable, .write = writable, .exec = executable
-			});
-		}
-		else {
+		PageAttributes attr {
+			.read = readable, .write = writable, .exec = executable
+		};
+		if (!this->m_protect_segments) {
 			// this might help execute simplistic barebones programs
-			this->set_page_attr(hdr->p_vaddr, len, {
-				 .read = true, .write = true, .exec = true
+			attr = { .read = true, .write = true, .exec = true };
+		}
+		// load into virtual memory, and set permissions
+		const size_t mapped = this->binary_map_ph(hdr, attr);
+		if (mapped < len) {
+			const address_t dst = hdr->p_vaddr + mapped;
+			// with pages larger than the segment alignment, the edge
+			// pages can have parts of other segments loaded already
+			const address_t last = dst + (len - mapped) - 1;
+			const address_t edges[2] = { dst >> Page::SHIFT, last >> Page::SHIFT };
+			const bool loaded[2] = {
+				m_pages.find(edges[0]) != nullptr, m_pages.find(edges[1]) != nullptr };
+			const PageAttributes before[2] = {
+				get_pageno(edges[0]).attr, get_pageno(edges[1]).attr };
+
+			this->memcpy(dst, src + mapped, len - mapped);
+			this->set_page_attr(dst, len - mapped, attr);
+			// such pages allow what every segment in them does
+			for (int i = 0; i < 2; i++) {
+				if (loaded[i] && this->m_protect_segments) {
+					this->apply_page_attr(this->create_page(edges[i]), {
+						.read  = attr.read  || before[i].read,
+						.write = attr.write || before[i].write,
+						.exec  = attr.exec  || before[i].exec });
+				}
+			}
+		}
+	}
+
+	template <int W>
+	size_t Memory<W>::binary_map_ph(const Phdr* hdr, PageAttributes attr)
+	{
+		// whole read-only pages of a binary with an owner are used as they
+		// are, as shared pages, which get copied if anything writes to them
+		const auto* src = m_binary.data() + hdr->p_offset;
+		if (flat_memory_enabled || attr.write || m_binary.owner() == nullptr
+			|| (uintptr_t) src % Page::size() != 0 || hdr->p_vaddr % Page::size() != 0)
+			return 0;
+		auto mapped = std::make_shared<SharedPages>();
+		attr.shared = true;
+		const address_t first = hdr->p_vaddr >> Page::SHIFT;
+		size_t count = 0;
+		for (; count < hdr->p_filesz / Page::size(); count++) {
+			// a page could be there already, from another segment
+			if (m_pages.find(first + count) != nullptr) break;
+			auto* page = new Page(*(PageData*) &src[count * Page::size()]);
+			page->attr = attr;
+			mapped->pages.push_back(page);
+			m_pages.insert(first + count, page);
+			this->tlb_evict(first + count);
+		}
+		m_pages_highest = std::max(m_pages_highest, m_pages.size());
+		if (count > 0) {
+			m_shared_pages.push_back(std::move(mapped));
+		}
+		return count * Page::size();
+	}
+
+	template <int W>
+	void Memory<W>::binary_load_exec_segment(const Phdr* phdr, size_t count)
+	{
+		address_t begin = ~(address_t) 0;
+		address_t end   = 0;
+		for (const auto* hdr = phdr; hdr < phdr + count; hdr++)
+		{
+			if (hdr->p_type == PT_LOAD && (hdr->p_flags & PF_X)) {
+				begin = std::min(begin, (address_t) hdr->p_vaddr);
+				end   = std::max(end, (address_t) (hdr->p_vaddr + hdr->p_filesz));
+			}
+		}
+		begin &= ~(address_t) (Page::size()-1);
+		end = (end + Page::size()-1) & ~(address_t) (Page::size()-1);
+		if (begin >= end) return;
+		// the copy must never go stale, so every page
+		// has to be executable and read-only
+		for (address_t addr = begin; addr < end; addr += Page::size())
+		{
+			const auto& attr = this->get_page_attr(addr);
+			if (attr.write || !attr.exec) return;
+		}
+		m_exec.begin = begin;
+		m_exec.size  = end - begin;
+		// the binary can be used as it is when it has the same bytes, in
+		// the same order, eg. when the pages were mapped from it
+		const uint8_t* mapped = this->get_pageno(begin >> Page::SHIFT).data();
+		if (m_binary.owner() == nullptr
+			|| mapped < m_binary.begin() || mapped >= m_binary.end())
+			mapped = nullptr;
+		for (address_t addr = begin; mapped && addr < end; addr += Page::size())
+		{
+			const auto* data = this->get_page(addr).data();
+			const auto* expected = mapped + (addr - begin);
+			if (data != expected && (expected + Page::size() > m_binary.end()
+				|| std::memcmp(data, expected, Page::size()) != 0))
+				mapped = nullptr;
+		}
+		if (mapped != nullptr) {
+			m_exec.data = std::shared_ptr<uint8_t[]> (m_binary.owner(), (uint8_t*) mapped);
+		} else {
+			m_exec.data.reset(new uint8_t[m_exec.size]);
+			this->memcpy_out(m_exec.data.get(), begin, m_exec.size);
+		}
+#ifdef RISCV_INSTR_CACHE
+		// the decoder cache of the segment is never evicted
+		const size_t entries = m_exec.size / DecoderCache<Page::SIZE>::DIVISOR;
+		const size_t bytes = entries * sizeof(DecoderEntry<W>);
+		if (bytes <= m_decoder_cache_max) {
+			m_exec.decoder_cache.reset(new DecoderEntry<W>[entries] {});
+			m_decoder_cache_size += bytes;
+		} else {
+			m_exec.decoder_cache = nullptr;
+		}
+#endif
+		// the last 16-bit slot is always fetched through its page
+		m_exec.fetch_size = m_exec.size - 2;
+
+		if (riscv::verbose_machine) {
+		printf("* Execute segment from %p to %p\n",
+				(void*) (uintptr_t) begin, (void*) (uintptr_t) end);
+		}
+	}
+
+#ifdef RISCV_INSTR_CACHE
+	template <int W>
+	void Memory<W>::create_decoder_cache(Page& page)
+	{
+		// other machines can be executing from shared pages
+		assert(!page.attr.shared);
+		constexpr size_t bytes = sizeof(DecoderCache<Page::SIZE>);
+		if (UNLIKELY(m_decoder_cache_size + bytes > m_decoder_cache_max)) {
+			// only decoding is lost, so simply start over
+			m_pages.for_each([this] (address_t, Page* page) {
+				this->free_decoder_cache(*page);
 			});
 		}
+		m_decoder_cache_size += bytes;
+		page.create_decoder_cache();
+		// writes to the page must now go through write tracking
+		for (auto& entry : m_wr_tlb) {
+			if (entry.data == page.data()) entry = {};
+		}
+		this->flat_protect(page);
+	}
+
+	template <int W>
+	void Memory<W>::free_decoder_cache(Page& page) noexcept
+	{
+		if (page.decoder_cache() != nullptr) {
+			m_decoder_cache_size -= sizeof(DecoderCache<Page::SIZE>);
+			page.free_decoder_cache();
+			this->flat_protect(page);
+		}
+	}
+#endif
+
+	template <int W>
+	void Memory<W>::invalidate_decoder_caches() noexcept
+	{
+#ifdef RISCV_INSTR_CACHE
+		// shared pages are never written to, and other machines execute from them
+		m_pages.for_each([] (address_t, Page* page) {
+			if (!page->attr.shared)
+				page->invalidate_decoder_cache(Page::size());
+		});
+#endif
 	}
 
 	// ELF32 and ELF64 loader
@@ -150,6 +401,10 @@ namespace riscv
 			}
 		}
 
+		if (this->m_load_program) {
+			binary_load_exec_segment(phdr, program_headers);
+		}
+
 		//this->relocate_section(".rela.dyn", ".symtab");
 
 		// NOTE: if the stack is very low, some stack pointer value could
@@ -165,6 +420,29 @@ namespace riscv
 		}
 	}
 
+	template <int W>
+	void Memory<W>::image_loader()
+	{
+		for (const auto& [pageno, page] : m_image->pages) {
+			if constexpr (flat_memory_enabled) {
+				// the page data has to be in the arena
+				auto& copy = this->allocate_page(pageno);
+				copy.attr = page->attr;
+				copy.attr.shared = false;
+				copy.page() = page->page();
+				this->flat_protect(pageno);
+			} else {
+				m_pages.insert(pageno, page);
+			}
+		}
+		m_pages_highest = std::max(m_pages_highest, m_pages.size());
+		// the decoder cache is fully decoded, and never written to
+		this->m_exec = m_image->exec;
+		this->m_start_address = m_image->start_address;
+		this->m_stack_address = m_image->stack_address;
+		this->m_exit_address  = m_image->exit_address;
+	}
+
 	template <int W>
 	const typename Memory<W>::Shdr* Memory<W>::section_by_name(const char* name) const
 	{
@@ -248,12 +526,45 @@ namespace riscv
 	template <int W>
 	Page& Memory<W>::allocate_page(const size_t page)
 	{
-		const auto& it = pages().emplace(page, new Page);
+		auto* result = pages().insert(page, this->new_page(page));
 		m_pages_highest = std::max(m_pages_highest, pages().size());
 		// if this page was read-cached, invalidate it
-		this->invalidate_page(page, *it.first->second);
+		this->invalidate_page(page, *result);
 		// return new page
-		return *it.first->second;
+		return *result;
+	}
+
+	template <int W>
+	Page* Memory<W>::new_page(address_t pageno)
+	{
+#ifdef RISCV_FLAT_MEMORY
+		// the page data is in the arena, at the address of the page
+		return new Page(*(PageData*) &m_flat.host()[(uint64_t) pageno << Page::SHIFT]);
+#else
+		(void) pageno;
+		auto* data = new (m_arena.allocate()) PageData;
+		auto* page = new Page(*data);
+		page->m_arena_data = true;
+		return page;
+#endif
+	}
+
+	template <int W>
+	Page& Memory<W>::copy_shared_page(address_t pageno, const Page& shared)
+	{
+		auto* page = this->new_page(pageno);
+		page->attr = shared.attr;
+		page->attr.shared = false;
+		page->page() = shared.page();
+		page->copy_trap(shared);
+		m_pages.erase(pageno);
+		m_pages.insert(pageno, page);
+		// the CPU may be executing from the shared page
+		if (shared.attr.exec) {
+			machine().cpu.reset_page_cache();
+		}
+		this->invalidate_page(pageno, *page);
+		return *page;
 	}
 
 	template <int W>
@@ -267,22 +578,28 @@ namespace riscv
 		throw MachineException(OUT_OF_MEMORY, "Out of memory", mem.pages_total());
 	}
 
+	// the static pages do not take their data from the page pool,
+	// as its thread caches are destroyed before them at exit
+	alignas(Page::SIZE) static PageData zeroed_data;
+	alignas(Page::SIZE) static PageData guarded_data;
+	alignas(Page::SIZE) static PageData device_data;
+
 	static Page zeroed_page {
-		PageAttributes {
+		zeroed_data, PageAttributes {
 			.read   = true,
 			.write  = false,
 			.exec   = false,
 			.is_cow = true
-		}, {}
+		}
 	};
 	static Page guarded_page {
-		PageAttributes {
+		guarded_data, PageAttributes {
 			.read   = false,
 			.write  = false,
 			.exec   = false,
 			.is_cow = false,
 			.shared = true
-		}, {}
+		}
 	};
 	const Page& Page::cow_page() noexcept {
 		return zeroed_page; // read-only, zeroed page
@@ -290,6 +607,159 @@ namespace riscv
 	const Page& Page::guard_page() noexcept {
 		return guarded_page; // inaccessible page
 	}
+	static Page device_window {
+		device_data, PageAttributes {
+			.read   = true,
+			.write  = true,
+			.exec   = false,
+			.is_cow = false,
+			.shared = true
+		}
+	};
+	// the trap keeps the page out of the caches, and is never called,
+	// as Memory sends accesses to the device instead
+	static const bool device_window_trapped = (device_window.set_trap(
+		[] (Page&, uint32_t, int, int64_t) -> int64_t {
+			throw MachineException(ILLEGAL_OPERATION, "Device page accessed directly");
+		}), true);
+	const Page& Page::device_page() noexcept {
+		return device_window;
+	}
+
+	template <int W>
+	void Memory<W>::add_device(MMIODevice<W> device)
+	{
+		if (device.size == 0 || ((device.base | device.size) & (Page::size()-1)) != 0)
+			throw MachineException(ILLEGAL_OPERATION,
+				"Devices must be at whole pages", device.base);
+		auto it = std::upper_bound(m_devices.begin(), m_devices.end(), device.base,
+			[] (address_t base, const auto& dev) { return base < dev.base; });
+		if ((it != m_devices.end() && it->base - device.base < device.size)
+			|| (it != m_devices.begin() && (it-1)->contains(device.base)))
+			throw MachineException(ILLEGAL_OPERATION,
+				"Devices can not overlap", device.base);
+		// a device with only memory behind it gets pages of that memory
+		const bool mapped = device.data != nullptr
+			&& device.read == nullptr && device.write == nullptr;
+		if (!mapped && !memory_traps_enabled)
+			throw MachineException(ILLEGAL_OPERATION,
+				"Devices with handlers need memory traps", device.base);
+		if (mapped && (uintptr_t) device.data % alignof(PageData) != 0)
+			throw MachineException(ILLEGAL_OPERATION,
+				"Device memory is not aligned", device.base);
+
+		this->free_pages(device.base, device.size);
+		for (address_t offset = 0; offset < device.size; offset += Page::size())
+		{
+			const address_t pageno = page_number(device.base + offset);
+			if (mapped) {
+				if (m_dirty != nullptr) {
+					this->mark_dirty(pageno);
+				}
+				auto* page = new Page(*(PageData*) &device.data[offset]);
+				page->m_device_data = true;
+				m_pages.insert(pageno, page);
+				this->tlb_evict(pageno);
+				this->flat_protect(pageno);
+			} else {
+				this->install_shared_page(pageno, Page::device_page());
+			}
+		}
+		m_pages_highest = std::max(m_pages_highest, m_pages.size());
+		m_devices.insert(it, std::move(device));
+	}
+
+	template <int W>
+	void Memory<W>::remove_device(address_t base)
+	{
+		auto it = std::find_if(m_devices.begin(), m_devices.end(),
+			[base] (const auto& dev) { return dev.base == base; });
+		if (it == m_devices.end())
+			throw MachineException(ILLEGAL_OPERATION, "No device at address", base);
+		// the pages go back to being unused memory
+		this->free_pages(it->base, it->size);
+		m_devices.erase(it);
+	}
+
+	template <int W>
+	const MMIODevice<W>* Memory<W>::device_at(address_t addr) const noexcept
+	{
+		auto it = std::upper_bound(m_devices.begin(), m_devices.end(), addr,
+			[] (address_t addr, const auto& dev) { return addr < dev.base; });
+		if (it != m_devices.begin() && (it-1)->contains(addr))
+			return &*(it-1);
+		return nullptr;
+	}
+
+	template <int W>
+	uint64_t Memory<W>::device_read(address_t addr, int size)
+	{
+		const auto* dev = this->device_at(addr);
+		const address_t offset = addr - (dev ? dev->base : 0);
+		if (dev && dev->read != nullptr) {
+			return dev->read(offset, size);
+		} else if (dev && dev->data != nullptr && offset + size <= dev->size) {
+			uint64_t value = 0;
+			std::memcpy(&value, &dev->data[offset], size);
+			return value;
+		}
+		this->protection_fault();
+		__builtin_unreachable();
+	}
+	template <int W>
+	void Memory<W>::device_write(address_t addr, int size, uint64_t value)
+	{
+		const auto* dev = this->device_at(addr);
+		const address_t offset = addr - (dev ? dev->base : 0);
+		if (dev && dev->write != nullptr) {
+			dev->write(offset, size, value);
+		} else if (dev && dev->data != nullptr && offset + size <= dev->size) {
+			std::memcpy(&dev->data[offset], &value, size);
+		} else {
+			this->protection_fault();
+		}
+	}
+
+	// bulk transfers stay within a page, and so within one device
+	template <int W>
+	void Memory<W>::device_memcpy_out(uint8_t* dst, address_t src, size_t len) const
+	{
+		const auto* dev = this->device_at(src);
+		if (dev && dev->data != nullptr) {
+			std::memcpy(dst, &dev->data[src - dev->base], len);
+		} else if (dev && dev->read != nullptr) {
+			for (size_t i = 0; i < len; i++)
+				dst[i] = dev->read(src - dev->base + i, 1);
+		} else {
+			throw MachineException(PROTECTION_FAULT, "Protection fault", src);
+		}
+	}
+	template <int W>
+	void Memory<W>::device_memcpy(address_t dst, const uint8_t* src, size_t len)
+	{
+		const auto* dev = this->device_at(dst);
+		if (dev && dev->data != nullptr) {
+			std::memcpy(&dev->data[dst - dev->base], src, len);
+		} else if (dev && dev->write != nullptr) {
+			for (size_t i = 0; i < len; i++)
+				dev->write(dst - dev->base + i, 1, src[i]);
+		} else {
+			this->protection_fault();
+		}
+	}
+	template <int W>
+	void Memory<W>::device_memset(address_t dst, uint8_t value, size_t len)
+	{
+		const auto* dev = this->device_at(dst);
+		if (dev && dev->data != nullptr) {
+			std::memset(&dev->data[dst - dev->base], value, len);
+		} else if (dev && dev->write != nullptr) {
+			for (size_t i = 0; i < len; i++)
+				dev->write(dst - dev->base + i, 1, value);
+		} else {
+			this->protection_fault();
+		}
+	}
 
 	template <int W>
 	void Memory<W>::install_shared_page(address_t pageno, const Page& shared_page)
@@ -301,30 +771,62 @@ namespace riscv
 			throw MachineException(ILLEGAL_OPERATION,
 				"The provided page did not have the shared attribute", pageno);
 
-		// NOTE: If you insert a const Page, DON'T modify it! The machine
-		// won't, unless system-calls do or manual intervention happens!
-		m_pages.insert({pageno, const_cast<Page*> (&shared_page)});
+		if (m_dirty != nullptr) {
+			this->mark_dirty(pageno);
+		}
+		// NOTE: the page is never modified through the machine, as writes
+		// go to a copy, but page data can still be changed directly
+		m_pages.insert(pageno, const_cast<Page*> (&shared_page));
+		// the CoW page may be cached for reading
+		this->tlb_evict(pageno);
+		this->flat_protect(pageno);
 	}
 
 	template <int W>
 	std::vector<std::pair<address_type<W>, Page*>>
 		Memory<W>::convert_to_shared_memory()
 	{
+		if constexpr (flat_memory_enabled) {
+			// the page data is in the arena, which belongs to the machine
+			throw MachineException(ILLEGAL_OPERATION,
+				"Flat memory can not be converted to shared memory");
+		}
 		// shared pages that has to be manually managed by the receiver
 		std::vector<std::pair<address_t, Page*>> result;
 		// NOTE: maybe result.reserve(m_pages.size()) here?
-		for (auto it : m_pages) {
-			auto* page = it.second;
+		m_pages.for_each([this, &result] (address_t pageno, Page* page) {
 			assert(page->attr.is_cow == false);
-			// convert all non-shared pages to shared and collect them
-			if (!page->attr.shared) {
+			// convert all non-shared pages to shared and collect them,
+			// except device memory, which the fork maps by itself
+			if (!page->attr.shared && !page->m_device_data) {
+#ifdef RISCV_INSTR_CACHE
+				// both machines execute from the page, and decode copies of it
+				this->free_decoder_cache(*page);
+#endif
 				page->attr.shared = true;
-				result.emplace_back(it.first, page);
+				result.emplace_back(pageno, page);
 			}
-		}
+		});
+		// writes to the pages must now make copies
+		m_wr_tlb.fill({});
 		return result;
 	}
 
+	template <int W>
+	address_type<W> Memory<W>::resolve_address(const char* name) const
+	{
+		// program images have an index of the symbols
+		if (m_image != nullptr) return m_image->resolve(name);
+
+		const auto& it = sym_lookup.find(name);
+		if (it != sym_lookup.end()) return it->second;
+
+		auto* sym = resolve_symbol(name);
+		address_t addr = (sym) ? sym->st_value : 0x0;
+		sym_lookup.emplace(strdup(name), addr);
+		return addr;
+	}
+
 	template <int W>
 	typename Memory<W>::Callsite Memory<W>::lookup(address_t address) const
 	{
@@ -1,13 +1,18 @@
 #pragma once
+#include "binary_view.hpp"
 #include "common.hpp"
 #include "elf.hpp"
 #include "types.hpp"
 #include "page.hpp"
+#include "page_table.hpp"
+#ifdef RISCV_FLAT_MEMORY
+#include "flat_arena.hpp"
+#endif
 #include <cassert>
 #include <cstring>
 #include <EASTL/allocator_malloc.h>
+#include <EASTL/fixed_vector.h>
 #include <EASTL/string_map.h>
-#include <EASTL/unordered_map.h>
 #include "util/function.hpp"
 #include <numeric>
 #include <string>
@@ -16,6 +21,63 @@
 namespace riscv
 {
 	template<int W> struct Machine;
+	template<int W> struct ProgramImage;
+
+	// a flat, read-only copy of the executable segments of the ELF binary,
+	// so that fetching instructions does not have to look up pages
+	template<int W>
+	struct ExecSegment
+	{
+		using address_t = address_type<W>;
+
+		// true when a whole 32-bit instruction can be read at @addr
+		bool contains(address_t addr) const noexcept {
+			return addr - begin < fetch_size;
+		}
+		bool overlaps(address_t addr, size_t len) const noexcept {
+			return fetch_size != 0 && addr < begin + size && begin < addr + len;
+		}
+		template <typename T>
+		T read(address_t addr) const noexcept {
+			// compressed instructions are only 2-byte aligned
+			T value;
+			std::memcpy(&value, &data[addr - begin], sizeof(T));
+			return value;
+		}
+
+		address_t begin = 0;
+		address_t size  = 0;
+		address_t fetch_size = 0; // zero when disabled
+		std::shared_ptr<uint8_t[]> data = nullptr;
+#ifdef RISCV_INSTR_CACHE
+		// decoder cache entries for the whole segment
+		std::shared_ptr<DecoderEntry<W>[]> decoder_cache = nullptr;
+#endif
+	};
+
+	// A device at whole pages of guest memory. Guest accesses go to @read
+	// and @write, with the offset from @base and the size of the access.
+	// A device can also have @data, the host memory behind all of it,
+	// which bulk transfers like memcpy() and gather() then use directly.
+	// A RAM-like device with only @data is mapped as pages of that memory,
+	// and is as fast as any other memory.
+	template<int W>
+	struct MMIODevice
+	{
+		using address_t = address_type<W>;
+		using read_t  = Function<uint64_t(address_t offset, int size)>;
+		using write_t = Function<void(address_t offset, int size, uint64_t value)>;
+
+		bool contains(address_t addr) const noexcept {
+			return addr - base < size;
+		}
+
+		address_t base = 0;
+		address_t size = 0;
+		read_t    read  = nullptr;
+		write_t   write = nullptr;
+		uint8_t*  data  = nullptr;
+	};
 
 	template<int W>
 	struct Memory
@@ -31,9 +93,24 @@ namespace riscv
 		template <typename T>
 		void write(address_t dst, T value);
 
+		// direct-mapped caches of host page data for read() and write()
+		static constexpr size_t TLB_ENTRIES = 16;
+
 		void memset(address_t dst, uint8_t value, size_t len);
 		void memcpy(address_t dst, const void* src, size_t);
 		void memcpy_out(void* dst, address_t src, size_t) const;
+		// guest to guest operations, which check permissions and go through
+		// traps like the guest does, and otherwise work a page at a time
+		void fill(address_t dst, uint8_t value, size_t len);
+		void copy_within(address_t dst, address_t src, size_t len); // no overlap
+		void move(address_t dst, address_t src, size_t len);
+		// host views of the guest memory at [addr, addr+len), one per run of
+		// pages that are contiguous on the host, checked for reading, and
+		// pages with a trap (other than devices with memory) fault. They
+		// can be passed straight to writev(), as vBuffer is laid out like iovec.
+		struct vBuffer { const uint8_t* ptr; size_t len; };
+		using vBuffers = eastl::fixed_vector<vBuffer, 8, true, eastl::allocator_malloc>;
+		vBuffers gather(address_t addr, size_t len);
 		// gives a sequential view of the data at address, with the possibility
 		// of optimizing away a copy if the data crosses no page-boundaries
 		void memview(address_t addr, size_t len,
@@ -79,11 +156,18 @@ namespace riscv
 		// page creation & destruction
 		Page& allocate_page(const size_t page);
 		void  free_pages(address_t, size_t len);
+		// zeroes memory, leaving whole pages as (or back to) CoW zero pages
+		void  zero_range(address_t, size_t len);
 		// page faults
 		void set_page_fault_handler(page_fault_cb_t h) { this->m_page_fault_handler = h; }
 		static Page& default_page_fault(Memory&, const size_t page);
 		// NOTE: use print_and_pause() to immediately break!
 		void trap(address_t page_addr, mmio_cb_t callback);
+		// devices replace the memory at their pages, which are given back,
+		// and can not overlap. Forks map the same @data, it is never copied.
+		void add_device(MMIODevice<W>);
+		void remove_device(address_t base);
+		const MMIODevice<W>* device_at(address_t) const noexcept;
 		// shared pages (regular pages will have priority!)
 		size_t nonshared_pages_active() const noexcept;
 		void   install_shared_page(address_t pageno, const Page&);
@@ -91,13 +175,32 @@ namespace riscv
 		std::vector<std::pair<address_t, Page*>> convert_to_shared_memory();
 
 		const auto& binary() const noexcept { return m_binary; }
+		const auto& exec_segment() const noexcept { return m_exec; }
+#ifdef RISCV_INSTR_CACHE
+		// creates the decoder cache of an executable page, evicting
+		// the other pages caches when going over the budget
+		void create_decoder_cache(Page&);
+		size_t decoder_cache_size() const noexcept { return m_decoder_cache_size; }
+#endif
+		// makes instruction fetch see every write to memory that bypassed
+		// the memory functions, eg. through page data (FENCE.I)
+		void invalidate_decoder_caches() noexcept;
 		void reset();
 		// serializes all the machine state + a tiny header to @vec
 		void serialize_to(std::vector<uint8_t>& vec);
 		// returns the machine to a previously stored state
 		void deserialize_from(const std::vector<uint8_t>&, const SerializedMachine<W>&);
+		// keeps the original of every page that changes from now on,
+		// so that restore_checkpoint() can undo just those changes
+		void checkpoint();
+		void restore_checkpoint();
+		bool has_checkpoint() const noexcept { return m_dirty != nullptr; }
+		size_t dirty_pages() const noexcept { return m_dirty ? m_dirty->size() : 0; }
 
-		Memory(Machine<W>&, const std::vector<uint8_t>&, MachineOptions);
+		Memory(Machine<W>&, BinaryView, MachineOptions);
+		Memory(Machine<W>&, std::shared_ptr<const ProgramImage<W>>, MachineOptions);
+		// shares every page of @parent, see Machine::fork()
+		Memory(Machine<W>&, Memory& parent);
 		~Memory();
 	private:
 		inline auto& create_attr(const address_t address);
@@ -105,15 +208,44 @@ namespace riscv
 			return address >> Page::SHIFT;
 		}
 		void clear_all_pages();
+		void mark_dirty(address_t pageno);
+		void discard_checkpoint() noexcept;
 		void initial_paging();
 		void invalidate_page(address_t pageno, Page&);
+		Page* new_page(address_t pageno);
+		// shared pages are never written to, so writes go to a copy
+		Page& copy_shared_page(address_t pageno, const Page&);
+		inline void flat_protect(address_t pageno);
+		inline void flat_protect(const Page&);
+		template <typename T> T read_miss(address_t src);
+		template <typename T> void write_miss(address_t dst, T value);
+		inline void tlb_evict(address_t pageno) noexcept;
+		void tlb_flush() noexcept;
+		inline void apply_page_attr(Page&, PageAttributes);
+		// the page when it can be accessed directly, nullptr when it has a trap
+		inline const Page* span_source(address_t pageno);
+		inline Page* span_destination(address_t pageno);
+		inline void copy_span(address_t dst, address_t src, size_t len, bool backward);
+#ifdef RISCV_INSTR_CACHE
+		void free_decoder_cache(Page&) noexcept;
+#endif
+		inline void invalidate_exec_segment(address_t, size_t len) noexcept;
 		void protection_fault();
+		// accesses to devices without pages of their own
+		uint64_t device_read(address_t, int size);
+		void device_write(address_t, int size, uint64_t value);
+		void device_memcpy_out(uint8_t* dst, address_t src, size_t len) const;
+		void device_memcpy(address_t dst, const uint8_t* src, size_t len);
+		void device_memset(address_t dst, uint8_t value, size_t len);
 		// ELF stuff
 		using Ehdr = typename Elf<W>::Ehdr;
 		using Phdr = typename Elf<W>::Phdr;
 		using Shdr = typename Elf<W>::Shdr;
 		void binary_loader();
+		void image_loader();
 		void binary_load_ph(const Phdr*);
+		size_t binary_map_ph(const Phdr*, PageAttributes);
+		void binary_load_exec_segment(const Phdr*, size_t count);
 		template <typename T> T* elf_offset(intptr_t ofs) const {
 			return (T*) &m_binary.at(ofs);
 		}
@@ -131,14 +263,48 @@ namespace riscv
 
 		Machine<W>& m_machine;
 
-		const Page* m_current_rd_ptr  = nullptr;
-		address_t   m_current_rd_page = -1;
-		Page*     m_current_wr_ptr  = nullptr;
-		address_t m_current_wr_page = -1;
-		eastl::unordered_map<address_t, Page*>  m_pages;
+		// a page only gets an entry when the access is allowed and needs
+		// nothing else (no trap, and no decoder cache for writes), so a
+		// hit is one tag compare and one load or store
+		template <typename Ptr>
+		struct TlbEntry {
+			address_t pageno = -1;
+			Ptr       data   = nullptr;
+		};
+		std::array<TlbEntry<const uint8_t*>, TLB_ENTRIES> m_rd_tlb;
+		std::array<TlbEntry<uint8_t*>, TLB_ENTRIES> m_wr_tlb;
+#ifdef RISCV_FLAT_MEMORY
+		FlatArena m_flat;
+#else
+		// the data of the pages this machine creates
+		PageArena m_arena;
+#endif
+		PageTable<W> m_pages;
+		// the original of every page that changed since the checkpoint,
+		// or the CoW page when there was no page (copies start without)
+		struct Originals : std::unique_ptr<PageTable<W>> {
+			Originals() = default;
+			Originals(const Originals&) : std::unique_ptr<PageTable<W>>() {}
+			Originals(Originals&&) = default;
+			Originals& operator= (Originals&&) = default;
+		};
+		Originals m_dirty;
+		// pages made shared by forking or by mapping the binary, which
+		// are deleted once every machine that can use them is gone
+		struct SharedPages {
+			std::vector<Page*> pages;
+			PageArena arena; // the data of pages made by a machine
+			~SharedPages() { for (auto* page : pages) delete page; }
+		};
+		std::vector<std::shared_ptr<const SharedPages>> m_shared_pages;
+		// devices by base address
+		std::vector<MMIODevice<W>> m_devices;
 		page_fault_cb_t m_page_fault_handler = nullptr;
 
-		const std::vector<uint8_t>& m_binary;
+		// the program, when loaded from an image
+		std::shared_ptr<const ProgramImage<W>> m_image = nullptr;
+		const BinaryView m_binary;
+		ExecSegment<W> m_exec;
 
 		// lookup tree for ELF symbol names
 		mutable eastl::string_map<address_t,
@@ -152,6 +318,10 @@ namespace riscv
 		const bool m_protect_segments;
 		size_t    m_pages_total   = 0; // max memory usage
 		size_t    m_pages_highest = 0; // max pages used
+#ifdef RISCV_INSTR_CACHE
+		size_t    m_decoder_cache_max  = 0;
+		size_t    m_decoder_cache_size = 0; // bytes in use
+#endif
 	};
 #include "memory_inline.hpp"
 }
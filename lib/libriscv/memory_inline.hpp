@@ -4,21 +4,39 @@ template <int W>
 template <typename T>
 T Memory<W>::read(address_t address)
 {
+#ifdef RISCV_FLAT_MEMORY
+	if (LIKELY(m_flat.allows(address, sizeof(T), FlatArena::READ))) {
+		return *(T*) &m_flat.host()[address];
+	}
+	return this->template read_miss<T>(address);
+#else
 	const auto pageno = page_number(address);
-	if (m_current_rd_page != pageno) {
-		m_current_rd_page = pageno;
-		m_current_rd_ptr = &get_pageno(pageno);
-		if (UNLIKELY(!m_current_rd_ptr->attr.read)) {
-			this->protection_fault();
-		}
+	const auto& entry = m_rd_tlb[pageno & (TLB_ENTRIES-1)];
+	if (LIKELY(entry.pageno == pageno)) {
+		return *(T*) &entry.data[address & (Page::size()-1)];
+	}
+	return this->template read_miss<T>(address);
+#endif
+}
+
+template <int W>
+template <typename T>
+T Memory<W>::read_miss(address_t address)
+{
+	const auto pageno = page_number(address);
+	const auto& page = get_pageno(pageno);
+	if (UNLIKELY(!page.attr.read)) {
+		this->protection_fault();
 	}
-	const auto& page = *m_current_rd_ptr;
 
 	if constexpr (memory_traps_enabled) {
 		if (UNLIKELY(page.has_trap())) {
+			if (page.is_device())
+				return (T) this->device_read(address, sizeof(T));
 			return page.trap(address & (Page::size()-1), sizeof(T) | TRAP_READ, 0);
 		}
 	}
+	m_rd_tlb[pageno & (TLB_ENTRIES-1)] = {(address_t) pageno, page.data()};
 	return page.template aligned_read<T>(address & (Page::size()-1));
 }
 
@@ -26,22 +44,52 @@ template <int W>
 template <typename T>
 void Memory<W>::write(address_t address, T value)
 {
+#ifdef RISCV_FLAT_MEMORY
+	if (LIKELY(m_flat.allows(address, sizeof(T), FlatArena::WRITE))) {
+		*(T*) &m_flat.host()[address] = value;
+		return;
+	}
+	this->template write_miss<T>(address, value);
+#else
 	const auto pageno = page_number(address);
-	if (m_current_wr_page != pageno) {
-		m_current_wr_page = pageno;
-		m_current_wr_ptr = &create_page(pageno);
-		if (UNLIKELY(!m_current_wr_ptr->attr.write)) {
-			this->protection_fault();
-		}
+	auto& entry = m_wr_tlb[pageno & (TLB_ENTRIES-1)];
+	if (LIKELY(entry.pageno == pageno)) {
+		*(T*) &entry.data[address & (Page::size()-1)] = value;
+		return;
+	}
+	this->template write_miss<T>(address, value);
+#endif
+}
+
+template <int W>
+template <typename T>
+void Memory<W>::write_miss(address_t address, T value)
+{
+	const auto pageno = page_number(address);
+	auto& page = create_page(pageno);
+	if (UNLIKELY(!page.attr.write)) {
+		this->protection_fault();
 	}
-	auto& page = *m_current_wr_ptr;
 
 	if constexpr (memory_traps_enabled) {
 		if (UNLIKELY(page.has_trap())) {
-			page.trap(address & (Page::size()-1), sizeof(T) | TRAP_WRITE, value);
+			if (page.is_device())
+				this->device_write(address, sizeof(T), value);
+			else
+				page.trap(address & (Page::size()-1), sizeof(T) | TRAP_WRITE, value);
 			return;
 		}
 	}
+#ifdef RISCV_INSTR_CACHE
+	// pages with decoded instructions are never cached for writing,
+	// so that every write to them invalidates the decoder cache
+	if (UNLIKELY(page.decoder_cache() != nullptr)) {
+		page.template aligned_write<T>(address & (Page::size()-1), value);
+		page.invalidate_decoder_cache((address & (Page::size()-1)) + sizeof(T));
+		return;
+	}
+#endif
+	m_wr_tlb[pageno & (TLB_ENTRIES-1)] = {(address_t) pageno, page.data()};
 	page.template aligned_write<T>(address & (Page::size()-1), value);
 }
 
@@ -55,9 +103,9 @@ inline const Page& Memory<W>::get_page(const address_t address) const noexcept
 template <int W>
 inline Page& Memory<W>::get_exec_pageno(const address_t page)
 {
-	auto it = m_pages.find(page);
-	if (LIKELY(it != m_pages.end())) {
-		return *it->second;
+	auto* page_ptr = m_pages.find(page);
+	if (LIKELY(page_ptr != nullptr)) {
+		return *page_ptr;
 	}
 	machine().cpu.trigger_exception(EXECUTION_SPACE_PROTECTION_FAULT);
 	__builtin_unreachable();
@@ -66,9 +114,9 @@ inline Page& Memory<W>::get_exec_pageno(const address_t page)
 template <int W>
 inline const Page& Memory<W>::get_pageno(const address_t page) const noexcept
 {
-	auto it = m_pages.find(page);
-	if (it != m_pages.end()) {
-		return *it->second;
+	const auto* page_ptr = m_pages.find(page);
+	if (page_ptr != nullptr) {
+		return *page_ptr;
 	}
 	// uninitialized memory is all zeroes on this system
 	return Page::cow_page();
@@ -77,20 +125,32 @@ inline const Page& Memory<W>::get_pageno(const address_t page) const noexcept
 template <int W>
 inline Page& Memory<W>::create_page(const address_t pageno)
 {
-	auto it = m_pages.find(pageno);
-	if (it != m_pages.end()) {
-		return *it->second;
+	if (UNLIKELY(m_dirty != nullptr)) {
+		this->mark_dirty(pageno);
+	}
+	auto* page_ptr = m_pages.find(pageno);
+	if (page_ptr != nullptr) {
+		if (UNLIKELY(page_ptr->attr.shared)) {
+			// the pages of devices have no data to copy
+			if (page_ptr->is_device()) return *page_ptr;
+			return this->copy_shared_page(pageno, *page_ptr);
+		}
+		return *page_ptr;
 	}
 	// create page on-demand, or throw exception when out of memory
 	if (this->m_page_fault_handler == nullptr) {
 		return default_page_fault(*this, pageno);
 	}
-	return m_page_fault_handler(*this, pageno);
+	auto& page = m_page_fault_handler(*this, pageno);
+	this->flat_protect(pageno);
+	return page;
 }
 
 template <int W> inline void
 Memory<W>::set_page_attr(address_t dst, size_t len, PageAttributes options)
 {
+	this->invalidate_exec_segment(dst, len);
+	this->tlb_flush();
 	const bool is_default = options.is_default();
 	while (len > 0)
 	{
@@ -98,14 +158,14 @@ Memory<W>::set_page_attr(address_t dst, size_t len, PageAttributes options)
 		const size_t pageno = dst >> Page::SHIFT;
 		// unfortunately, have to create pages for non-default attrs
 		if (!is_default) {
-			this->create_page(pageno).attr = options;
+			this->apply_page_attr(this->create_page(pageno), options);
 		} else {
 			// set attr on non-COW pages only!
 			const auto& page = this->get_pageno(pageno);
 			if (page.attr.is_cow == false) {
 				// this page has been written to, or had attrs set,
 				// otherwise it would still be CoW.
-				this->create_page(pageno).attr = options;
+				this->apply_page_attr(this->create_page(pageno), options);
 			}
 		}
 
@@ -113,6 +173,25 @@ Memory<W>::set_page_attr(address_t dst, size_t len, PageAttributes options)
 		len -= size;
 	}
 }
+template <int W> inline void
+Memory<W>::apply_page_attr(Page& page, PageAttributes options)
+{
+	// devices decide what is allowed themselves
+	if (page.is_device()) return;
+	page.attr = options;
+#ifdef RISCV_INSTR_CACHE
+	if (page.decoder_cache() != nullptr) {
+		// the page could have been written to while it was writable,
+		// and the CPU re-validates pages that lost their decoder cache
+		if (options.exec)
+			page.invalidate_decoder_cache(Page::size());
+		else
+			this->free_decoder_cache(page);
+	}
+#endif
+	this->flat_protect(page);
+}
+
 template <int W> inline
 const PageAttributes& Memory<W>::get_page_attr(address_t src) const noexcept
 {
@@ -123,49 +202,160 @@ const PageAttributes& Memory<W>::get_page_attr(address_t src) const noexcept
 
 
 template <int W> inline void
-Memory<W>::invalidate_page(address_t pageno, Page& page)
+Memory<W>::invalidate_page(address_t pageno, Page&)
+{
+	// the CoW page may be cached for reading
+	this->tlb_evict(pageno);
+	this->flat_protect(pageno);
+}
+
+template <int W> inline void
+Memory<W>::flat_protect(address_t pageno)
+{
+#ifdef RISCV_FLAT_MEMORY
+	// the arena only allows what needs no checks, and everything
+	// else takes the slow path of read() and write()
+	const Page* page = m_pages.find(pageno);
+	bool read = true, write = false; // the CoW page
+	if (page != nullptr) {
+		read = m_flat.owns(page->data()) && page->attr.read
+			&& !(memory_traps_enabled && page->has_trap());
+		write = read && page->attr.write;
+		// pages become writable once their originals are kept
+		write = write && (m_dirty == nullptr || m_dirty->find(pageno) != nullptr);
+#ifdef RISCV_INSTR_CACHE
+		write = write && page->decoder_cache() == nullptr;
+#endif
+	}
+	m_flat.protect((uint64_t) pageno << Page::SHIFT, Page::size(), read, write);
+#else
+	(void) pageno;
+#endif
+}
+template <int W> inline void
+Memory<W>::flat_protect(const Page& page)
+{
+#ifdef RISCV_FLAT_MEMORY
+	// only pages in the arena have a known address
+	if (m_flat.owns(page.data())) {
+		this->flat_protect((page.data() - m_flat.host()) >> Page::SHIFT);
+	}
+#else
+	(void) page;
+#endif
+}
+
+template <int W> inline void
+Memory<W>::tlb_evict(address_t pageno) noexcept
+{
+	m_rd_tlb[pageno & (TLB_ENTRIES-1)] = {};
+	m_wr_tlb[pageno & (TLB_ENTRIES-1)] = {};
+}
+
+template <int W> inline void
+Memory<W>::invalidate_exec_segment(address_t dst, size_t len) noexcept
 {
-	// it's only possible to a have CoW read-only page
-	if (m_current_rd_page == pageno) {
-		m_current_rd_ptr = &page;
+	// pages under the execute segment are changing, so fall back to
+	// fetching from pages (the buffers stay alive until the next reset)
+	if (UNLIKELY(m_exec.overlaps(dst, len))) {
+		m_exec.fetch_size = 0;
 	}
 }
 
 template <int W> inline void
 Memory<W>::free_pages(address_t dst, size_t len)
 {
+	this->invalidate_exec_segment(dst, len);
 	while (len > 0)
 	{
 		const size_t size = std::min(Page::size(), len);
 		const address_t pageno = dst >> Page::SHIFT;
 		auto& page = this->get_pageno(pageno);
 		if (page.attr.is_cow == false) {
+			if (UNLIKELY(m_dirty != nullptr)) {
+				this->mark_dirty(pageno);
+			}
 			m_pages.erase(pageno);
-			if (!page.attr.shared) delete &page;
+			this->tlb_evict(pageno);
+#ifdef RISCV_INSTR_CACHE
+			if (page.decoder_cache() != nullptr)
+				m_decoder_cache_size -= sizeof(DecoderCache<Page::SIZE>);
+#endif
+			if (!page.attr.shared) {
+#ifndef RISCV_FLAT_MEMORY
+				if (page.m_arena_data) m_arena.deallocate(page.m_data);
+#endif
+				delete &page;
+			}
+#ifdef RISCV_FLAT_MEMORY
+			m_flat.discard((uint64_t) pageno << Page::SHIFT, Page::size());
+			this->flat_protect(pageno);
+#endif
 		}
 		dst += size;
 		len -= size;
 	}
 }
 
+template <int W> inline void
+Memory<W>::zero_range(address_t dst, size_t len)
+{
+	// only the partial pages at the edges are written to
+	const size_t head = std::min(len, (Page::size() - dst) & (Page::size()-1));
+	if (head != 0) {
+		this->memset(dst, 0, head);
+		dst += head;
+		len -= head;
+	}
+	const size_t tail = len & (Page::size()-1);
+	if (tail != 0) {
+		len -= tail;
+		this->memset(dst + len, 0, tail);
+	}
+	while (len > 0)
+	{
+		const auto& page = this->get_pageno(dst >> Page::SHIFT);
+		if (page.attr.is_cow == false) {
+			// pages with other attributes, traps or host memory are kept
+			bool ours = page.m_owns_data || page.m_arena_data || page.attr.shared;
+#ifdef RISCV_FLAT_MEMORY
+			ours = ours || m_flat.owns(page.data());
+#endif
+			if (ours && page.attr.is_default() && !page.has_trap())
+				this->free_pages(dst, Page::size());
+			else
+				this->memset(dst, 0, Page::size());
+		}
+		dst += Page::size();
+		len -= Page::size();
+	}
+}
+
 template <int W>
 size_t Memory<W>::nonshared_pages_active() const noexcept
 {
-	return std::accumulate(m_pages.begin(), m_pages.end(),
-				0, [] (int value, const auto& it) {
-					return value + (!it.second->attr.shared ? 1 : 0);
-				});
+	size_t count = 0;
+	m_pages.for_each([&count] (address_t, const Page* page) {
+		if (!page->attr.shared) count++;
+	});
+	return count;
 }
 
 template <int W>
 void Memory<W>::memset(address_t dst, uint8_t value, size_t len)
 {
+	this->invalidate_exec_segment(dst, len);
 	while (len > 0)
 	{
 		const size_t offset = dst & (Page::size()-1); // offset within page
 		const size_t size = std::min(Page::size() - offset, len);
 		auto& page = this->create_page(dst >> Page::SHIFT);
-		__builtin_memset(page.data() + offset, value, size);
+		if (UNLIKELY(page.is_device())) {
+			this->device_memset(dst, value, size);
+		} else {
+			__builtin_memset(page.data() + offset, value, size);
+			page.invalidate_decoder_cache(offset + size);
+		}
 
 		dst += size;
 		len -= size;
@@ -175,13 +365,19 @@ void Memory<W>::memset(address_t dst, uint8_t value, size_t len)
 template <int W>
 void Memory<W>::memcpy(address_t dst, const void* vsrc, size_t len)
 {
+	this->invalidate_exec_segment(dst, len);
 	auto* src = (uint8_t*) vsrc;
 	while (len != 0)
 	{
 		const size_t offset = dst & (Page::size()-1); // offset within page
 		const size_t size = std::min(Page::size() - offset, len);
 		auto& page = this->create_page(dst >> Page::SHIFT);
-		std::copy(src, src + size, page.data() + offset);
+		if (UNLIKELY(page.is_device())) {
+			this->device_memcpy(dst, src, size);
+		} else {
+			std::copy(src, src + size, page.data() + offset);
+			page.invalidate_decoder_cache(offset + size);
+		}
 
 		dst += size;
 		src += size;
@@ -189,6 +385,110 @@ void Memory<W>::memcpy(address_t dst, const void* vsrc, size_t len)
 	}
 }
 
+template <int W>
+inline const Page* Memory<W>::span_source(address_t pageno)
+{
+	const auto& page = this->get_pageno(pageno);
+	if (UNLIKELY(!page.attr.read)) {
+		this->protection_fault();
+	}
+	if constexpr (memory_traps_enabled) {
+		if (UNLIKELY(page.has_trap())) return nullptr;
+	}
+	return &page;
+}
+template <int W>
+inline Page* Memory<W>::span_destination(address_t pageno)
+{
+	auto& page = this->create_page(pageno);
+	if (UNLIKELY(!page.attr.write)) {
+		this->protection_fault();
+	}
+	if constexpr (memory_traps_enabled) {
+		if (UNLIKELY(page.has_trap())) return nullptr;
+	}
+	return &page;
+}
+
+template <int W>
+void Memory<W>::fill(address_t dst, uint8_t value, size_t len)
+{
+	this->invalidate_exec_segment(dst, len);
+	while (len > 0)
+	{
+		const size_t offset = dst & (Page::size()-1);
+		const size_t size = std::min(Page::size() - offset, len);
+		auto* page = this->span_destination(dst >> Page::SHIFT);
+		if (LIKELY(page != nullptr)) {
+			__builtin_memset(page->data() + offset, value, size);
+			page->invalidate_decoder_cache(offset + size);
+		} else {
+			for (size_t i = 0; i < size; i++)
+				this->template write<uint8_t> (dst + i, value);
+		}
+
+		dst += size;
+		len -= size;
+	}
+}
+
+template <int W>
+inline void Memory<W>::copy_span(address_t dst, address_t src, size_t size, bool backward)
+{
+	// the destination first, as making it can replace a (shared) source page
+	auto* to = this->span_destination(dst >> Page::SHIFT);
+	const auto* from = this->span_source(src >> Page::SHIFT);
+	if (LIKELY(to != nullptr && from != nullptr)) {
+		const size_t offset = dst & (Page::size()-1);
+		std::memmove(to->data() + offset, from->data() + (src & (Page::size()-1)), size);
+		to->invalidate_decoder_cache(offset + size);
+		return;
+	}
+	// traps see every byte, in the order of the copy
+	for (size_t i = 0; i < size; i++) {
+		const size_t n = (backward) ? size-1 - i : i;
+		this->template write<uint8_t> (dst + n, this->template read<uint8_t> (src + n));
+	}
+}
+
+template <int W>
+void Memory<W>::copy_within(address_t dst, address_t src, size_t len)
+{
+	this->invalidate_exec_segment(dst, len);
+	while (len > 0)
+	{
+		const size_t size = std::min({Page::size() - (dst & (Page::size()-1)),
+			Page::size() - (src & (Page::size()-1)), len});
+		this->copy_span(dst, src, size, false);
+
+		dst += size;
+		src += size;
+		len -= size;
+	}
+}
+
+template <int W>
+void Memory<W>::move(address_t dst, address_t src, size_t len)
+{
+	// copying forwards only overwrites the source when dst is above it
+	if ((address_t) (dst - src) >= len) {
+		this->copy_within(dst, src, len);
+		return;
+	}
+	this->invalidate_exec_segment(dst, len);
+	while (len > 0)
+	{
+		// the spans end where the ranges do, and start on a page or earlier
+		const address_t src_end = src + len;
+		const address_t dst_end = dst + len;
+		const size_t size = std::min({((dst_end - 1) & (Page::size()-1)) + 1,
+			((src_end - 1) & (Page::size()-1)) + 1, len});
+		this->copy_span(dst_end - size, src_end - size, size, true);
+
+		len -= size;
+	}
+}
+
 template <int W>
 void Memory<W>::memcpy_out(void* vdst, address_t src, size_t len) const
 {
@@ -198,7 +498,10 @@ void Memory<W>::memcpy_out(void* vdst, address_t src, size_t len) const
 		const size_t offset = src & (Page::size()-1);
 		const size_t size = std::min(Page::size() - offset, len);
 		const auto& page = this->get_page(src);
-		std::copy(page.data() + offset, page.data() + offset + size, dst);
+		if (UNLIKELY(page.is_device()))
+			this->device_memcpy_out(dst, src, size);
+		else
+			std::copy(page.data() + offset, page.data() + offset + size, dst);
 
 		dst += size;
 		src += size;
@@ -206,6 +509,39 @@ void Memory<W>::memcpy_out(void* vdst, address_t src, size_t len) const
 	}
 }
 
+template <int W>
+typename Memory<W>::vBuffers Memory<W>::gather(address_t addr, size_t len)
+{
+	vBuffers buffers;
+	while (len != 0)
+	{
+		const size_t offset = addr & (Page::size()-1);
+		const size_t size = std::min(Page::size() - offset, len);
+		const auto& page = this->get_page(addr);
+		if (UNLIKELY(!page.attr.read)) {
+			this->protection_fault();
+		}
+		const uint8_t* data = page.data() + offset;
+		if (UNLIKELY(page.is_device())) {
+			// only devices with memory can be viewed
+			const auto* dev = this->device_at(addr);
+			if (dev == nullptr || dev->data == nullptr) this->protection_fault();
+			data = &dev->data[addr - dev->base];
+		} else if (UNLIKELY(page.has_trap())) {
+			// the trap decides what reads see, so there is nothing to view
+			this->protection_fault();
+		}
+		if (!buffers.empty() && buffers.back().ptr + buffers.back().len == data)
+			buffers.back().len += size;
+		else
+			buffers.push_back({data, size});
+
+		addr += size;
+		len  -= size;
+	}
+	return buffers;
+}
+
 template <int W>
 void Memory<W>::memview(address_t addr, size_t len,
 	Function<void(const uint8_t*, size_t)> callback) const
@@ -215,13 +551,15 @@ void Memory<W>::memview(address_t addr, size_t len,
 	if (LIKELY(offset + len <= Page::size()))
 	{
 		const auto& page = this->get_page(addr);
-		callback(page.data() + offset, len);
-		return;
+		if (LIKELY(!page.is_device())) {
+			callback(page.data() + offset, len);
+			return;
+		}
 	}
 	// slow path
-	uint8_t buffer[len];
-	memcpy_out(buffer, addr, len);
-	callback(buffer, len);
+	std::unique_ptr<uint8_t[]> buffer(new uint8_t[len]);
+	memcpy_out(buffer.get(), addr, len);
+	callback(buffer.get(), len);
 }
 template <int W>
 template <typename T>
@@ -234,8 +572,10 @@ void Memory<W>::memview(address_t addr,
 	if (LIKELY(offset + sizeof(T) <= Page::size()))
 	{
 		const auto& page = this->get_page(addr);
-		callback(*(const T*) &page.data()[offset]);
-		return;
+		if (LIKELY(!page.is_device())) {
+			callback(*(const T*) &page.data()[offset]);
+			return;
+		}
 	}
 	// slow path
 	T object;
@@ -291,20 +631,15 @@ inline void Memory<W>::protection_fault()
 template <int W>
 void Memory<W>::trap(address_t page_addr, mmio_cb_t callback)
 {
+	this->invalidate_exec_segment(page_addr, Page::size());
 	auto& page = create_page(page_number(page_addr));
+	if (UNLIKELY(page.is_device())) {
+		throw MachineException(ILLEGAL_OPERATION,
+			"Pages of devices can not have traps", page_addr);
+	}
 	page.set_trap(callback);
-}
-
-template <int W>
-address_type<W> Memory<W>::resolve_address(const char* name) const
-{
-	const auto& it = sym_lookup.find(name);
-	if (it != sym_lookup.end()) return it->second;
-
-	auto* sym = resolve_symbol(name);
-	address_t addr = (sym) ? sym->st_value : 0x0;
-	sym_lookup.emplace(strdup(name), addr);
-	return addr;
+	this->tlb_evict(page_number(page_addr));
+	this->flat_protect(page_number(page_addr));
 }
 
 template <int W>
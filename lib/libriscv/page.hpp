@@ -5,6 +5,7 @@
 #include <type_traits>
 #include "common.hpp"
 #include "decoder_cache.hpp"
+#include "page_pool.hpp"
 #include "util/function.hpp"
 
 namespace riscv {
@@ -23,9 +24,16 @@ struct PageAttributes
 	}
 };
 
+#ifndef RISCV_PAGE_SIZE
+#define RISCV_PAGE_SIZE 4096
+#endif
+
 struct alignas(8) PageData {
-	static constexpr unsigned SIZE  = 4096;
-	static constexpr unsigned SHIFT = 12;
+	static constexpr unsigned SIZE  = RISCV_PAGE_SIZE;
+	static constexpr unsigned SHIFT = __builtin_ctz(SIZE);
+	// pages are protected by the host in flat memory, and mapped from files
+	static_assert(SIZE >= 4096 && (SIZE & (SIZE-1)) == 0,
+		"The page size must be a power of two, and at least 4096");
 
 	std::array<uint8_t, SIZE> buffer8 = {0};
 };
@@ -36,12 +44,21 @@ struct Page
 	static constexpr unsigned SHIFT = PageData::SHIFT;
 	using mmio_cb_t = Function<int64_t (Page&, uint32_t, int, int64_t)>;
 
-	Page() = default;
+	// the page data comes from the page pool (zeroed), or is a copy
+	Page() : m_data(new (PagePool::allocate_data()) PageData) {}
 	Page(const PageAttributes& a, const PageData& d)
-		: m_page(d), attr(a) {}
+		: attr(a), m_data(new (PagePool::allocate_data()) PageData(d)) {}
+	// page data that belongs to someone else, eg. the flat memory arena
+	explicit Page(PageData& external, const PageAttributes& a = {})
+		: attr(a), m_owns_data(false), m_data(&external) {}
+	Page(const Page&) = delete;
+	Page& operator= (const Page&) = delete;
+	~Page() {
+		if (m_owns_data) PagePool::deallocate_data(m_data);
+	}
 
-	auto& page() noexcept { return m_page; }
-	const auto& page() const noexcept { return m_page; }
+	auto& page() noexcept { return *m_data; }
+	const auto& page() const noexcept { return *m_data; }
 
 	template <typename T>
 	inline T aligned_read(uint32_t offset) const
@@ -72,8 +89,21 @@ struct Page
 		return SIZE;
 	}
 
+	// pages are recycled through the page pool
+	static void* operator new(size_t size) {
+		if (LIKELY(size == sizeof(Page))) return PagePool::allocate();
+		return ::operator new(size);
+	}
+	static void operator delete(void* ptr, size_t size) noexcept {
+		if (LIKELY(size == sizeof(Page))) PagePool::deallocate(ptr);
+		else ::operator delete(ptr);
+	}
+
 	static const Page& cow_page() noexcept;
 	static const Page& guard_page() noexcept;
+	// stands in for the pages of devices, see Memory::add_device()
+	static const Page& device_page() noexcept;
+	bool is_device() const noexcept { return this == &device_page(); }
 
 #ifdef RISCV_INSTR_CACHE
 	auto* decoder_cache() noexcept {
@@ -85,28 +115,53 @@ struct Page
 	void create_decoder_cache() {
 		m_decoder_cache.reset(new DecoderCache<Page::SIZE>);
 	}
+	void free_decoder_cache() noexcept {
+		m_decoder_cache.reset();
+	}
+#endif
+	// the page data before @end has changed
+	void invalidate_decoder_cache(size_t end) noexcept {
+#ifdef RISCV_INSTR_CACHE
+		if (m_decoder_cache != nullptr) m_decoder_cache->invalidate(end);
+#else
+		(void) end;
 #endif
+	}
 
 	bool has_trap() const noexcept { return m_trap != nullptr; }
-	void set_trap(mmio_cb_t newtrap) noexcept { this->m_trap = newtrap; }
+	void set_trap(mmio_cb_t newtrap) {
+		if (newtrap == nullptr) m_trap.reset();
+		else if (m_trap != nullptr) *m_trap = newtrap;
+		else m_trap.reset(new mmio_cb_t(newtrap));
+	}
+	// the same trap as @other, or none
+	void copy_trap(const Page& other) {
+		this->set_trap(other.has_trap() ? *other.m_trap : mmio_cb_t(nullptr));
+	}
 	int64_t trap(uint32_t offset, int mode, int64_t value) const;
 	static int trap_mode(int mode) noexcept { return mode & 0xF000; }
 
 	int64_t passthrough(uint32_t off, int mode, int64_t val);
 
-	// this combination has been benchmarked to be faster than
-	// page-aligning the PageData struct, and avoids an indirection
-	PageData m_page;
+	// the metadata is kept apart from the page-aligned page data,
+	// so that permission checks only touch a single cache line, and
+	// decoder caches and traps, which few pages have, are kept apart
+	// from the metadata, so that the records stay small
 	PageAttributes attr;
+	bool      m_owns_data = true;
+	bool      m_device_data = false; // see Memory::add_device()
+	bool      m_arena_data = false;  // see Memory::new_page()
+	PageData* m_data;
 #ifdef RISCV_INSTR_CACHE
 	std::unique_ptr<DecoderCache<Page::SIZE>> m_decoder_cache = nullptr;
 #endif
-	mmio_cb_t m_trap = nullptr;
+	std::unique_ptr<mmio_cb_t> m_trap = nullptr;
 };
+static_assert(sizeof(Page) <= 32, "Page records should stay small");
 
 inline int64_t Page::trap(uint32_t offset, int mode, int64_t value) const
 {
-	return m_trap((Page&) *this, offset, mode, value);
+	return (*m_trap)((Page&) *this, offset, mode, value);
 }
 
 inline int64_t Page::passthrough(uint32_t off, int mode, int64_t val)
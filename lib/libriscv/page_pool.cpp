@@ -0,0 +1,207 @@
+#include "page_pool.hpp"
+#include "page.hpp"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace riscv
+{
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+	struct FreeChunk {
+		FreeChunk* next;
+	};
+
+	struct Pool {
+		// constant-initialized, so that pages can be created
+		// by the constructors of other static objects
+		constexpr Pool(size_t block_size, size_t alignment)
+			: block_size(block_size), alignment(alignment) {}
+
+		const size_t block_size;
+		const size_t alignment;
+		std::mutex mutex;
+		FreeBlock* free = nullptr; // shared between threads
+		FreeChunk* free_chunks = nullptr; // given back by arenas
+		std::atomic<size_t> chunks {0};
+		std::atomic<size_t> in_use {0};
+
+		void give_back(FreeBlock*& head, size_t& count, size_t blocks)
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			for (; blocks > 0 && head != nullptr; blocks--, count--) {
+				auto* block = head;
+				head = block->next;
+				block->next = this->free;
+				this->free = block;
+			}
+		}
+		void refill(FreeBlock*& head, size_t& count)
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				for (size_t i = 0; i < PagePool::CHUNK_PAGES && this->free; i++) {
+					auto* block = this->free;
+					this->free = block->next;
+					block->next = head;
+					head = block;
+					count++;
+				}
+			}
+			if (head != nullptr) return;
+			// nothing to reuse, so carve out a new chunk
+			auto* chunk = this->new_chunk();
+			for (size_t i = 0; i < PagePool::CHUNK_PAGES; i++) {
+				auto* block = (FreeBlock*) &chunk[i * block_size];
+				block->next = head;
+				head = block;
+				count++;
+			}
+		}
+		char* new_chunk()
+		{
+			auto* chunk = (char*) ::operator new(PagePool::CHUNK_PAGES * block_size,
+				std::align_val_t(alignment));
+			this->chunks++;
+			return chunk;
+		}
+		// whole chunks for arenas, which are kept apart from the blocks
+		char* take_chunk()
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				if (auto* chunk = this->free_chunks) {
+					this->free_chunks = chunk->next;
+					return (char*) chunk;
+				}
+			}
+			return this->new_chunk();
+		}
+		void give_chunks(const std::vector<char*>& list) noexcept
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			for (auto* chunk : list) {
+				auto* free = (FreeChunk*) chunk;
+				free->next = this->free_chunks;
+				this->free_chunks = free;
+			}
+		}
+		PagePool::Stats stats() const noexcept {
+			const size_t chunks = this->chunks.load(std::memory_order_relaxed);
+			return PagePool::Stats {
+				.chunks = chunks,
+				.total  = chunks * PagePool::CHUNK_PAGES,
+				.in_use = this->in_use.load(std::memory_order_relaxed)
+			};
+		}
+	};
+	static Pool page_pool { sizeof(Page), alignof(Page) };
+	static Pool data_pool { sizeof(PageData), Page::size() };
+
+	struct ThreadCache {
+		Pool&      pool;
+		FreeBlock* head = nullptr;
+		size_t     count = 0;
+
+		void* allocate()
+		{
+			if (UNLIKELY(head == nullptr)) {
+				pool.refill(head, count);
+			}
+			auto* block = head;
+			head = block->next;
+			count--;
+			pool.in_use.fetch_add(1, std::memory_order_relaxed);
+			return block;
+		}
+		void deallocate(void* ptr) noexcept
+		{
+			auto* block = (FreeBlock*) ptr;
+			block->next = head;
+			head = block;
+			pool.in_use.fetch_sub(1, std::memory_order_relaxed);
+			if (++count > PagePool::THREAD_CACHE) {
+				pool.give_back(head, count, PagePool::THREAD_CACHE / 2);
+			}
+		}
+		~ThreadCache() {
+			pool.give_back(head, count, count);
+		}
+	};
+	static thread_local ThreadCache page_cache { page_pool };
+	static thread_local ThreadCache data_cache { data_pool };
+
+	void* PagePool::allocate() {
+		return page_cache.allocate();
+	}
+	void PagePool::deallocate(void* ptr) noexcept {
+		page_cache.deallocate(ptr);
+	}
+	void* PagePool::allocate_data() {
+		return data_cache.allocate();
+	}
+	void PagePool::deallocate_data(void* ptr) noexcept {
+		data_cache.deallocate(ptr);
+	}
+
+	void* PageArena::allocate()
+	{
+		void* block = m_free;
+		if (block != nullptr) {
+			m_free = ((FreeBlock*) block)->next;
+		} else {
+			if (m_next == PagePool::CHUNK_PAGES) {
+				m_chunks.reserve(m_chunks.size() + 1);
+				m_chunks.push_back(data_pool.take_chunk());
+				m_next = 0;
+			}
+			block = &m_chunks.back()[m_next++ * sizeof(PageData)];
+		}
+		m_in_use++;
+		data_pool.in_use.fetch_add(1, std::memory_order_relaxed);
+		return block;
+	}
+	void PageArena::deallocate(void* ptr) noexcept
+	{
+		auto* block = (FreeBlock*) ptr;
+		block->next = (FreeBlock*) m_free;
+		m_free = block;
+		m_in_use--;
+		data_pool.in_use.fetch_sub(1, std::memory_order_relaxed);
+	}
+	void PageArena::release() noexcept
+	{
+		if (m_chunks.empty()) return;
+		data_pool.give_chunks(m_chunks);
+		data_pool.in_use.fetch_sub(m_in_use, std::memory_order_relaxed);
+		m_chunks.clear();
+		m_free = nullptr;
+		m_next = PagePool::CHUNK_PAGES;
+		m_in_use = 0;
+	}
+	PageArena::PageArena(PageArena&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+	PageArena& PageArena::operator= (PageArena&& other) noexcept
+	{
+		if (this != &other) {
+			this->release();
+			m_chunks = std::move(other.m_chunks);
+			m_free   = std::exchange(other.m_free, nullptr);
+			m_next   = std::exchange(other.m_next, PagePool::CHUNK_PAGES);
+			m_in_use = std::exchange(other.m_in_use, 0);
+			other.m_chunks.clear();
+		}
+		return *this;
+	}
+
+	PagePool::Stats PagePool::stats() noexcept {
+		return page_pool.stats();
+	}
+	PagePool::Stats PagePool::data_stats() noexcept {
+		return data_pool.stats();
+	}
+}
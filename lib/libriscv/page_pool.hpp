@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace riscv
+{
+	// Process-wide pools of memory for Page objects and for page data,
+	// which is aligned to the page size. Freed memory is kept in a cache
+	// for the thread that freed it, and large caches are shared with
+	// other threads through the pool, so that creating and destroying
+	// machines never goes back to the global allocator. Memory given
+	// to the pools is kept until the process exits.
+	struct PagePool
+	{
+		static constexpr size_t CHUNK_PAGES = 32;  // allocated at a time
+		static constexpr size_t THREAD_CACHE = 256; // pages kept per thread
+
+		struct Stats {
+			size_t chunks;  // allocated from the system
+			size_t total;   // pages in all chunks
+			size_t in_use;  // pages that are alive
+		};
+		static Stats stats() noexcept;
+		static Stats data_stats() noexcept;
+
+		// memory for one Page
+		static void* allocate();
+		static void  deallocate(void*) noexcept;
+		// memory for one PageData
+		static void* allocate_data();
+		static void  deallocate_data(void*) noexcept;
+	};
+
+	// The page data of one machine, taken from the data pool a chunk at
+	// a time. Pages freed by the machine are reused by it, and release()
+	// gives every chunk back to the pool at once, without visiting pages.
+	struct PageArena
+	{
+		void* allocate();
+		void  deallocate(void*) noexcept;
+		void  release() noexcept;
+		size_t chunks() const noexcept { return m_chunks.size(); }
+
+		PageArena() = default;
+		// the pages of a copied machine are still the originals,
+		// so the new arena starts out empty
+		PageArena(const PageArena&) : PageArena() {}
+		PageArena(PageArena&&) noexcept;
+		PageArena& operator= (PageArena&&) noexcept;
+		~PageArena() { this->release(); }
+	private:
+		std::vector<char*> m_chunks;
+		void*  m_free = nullptr; // pages freed by the machine
+		size_t m_next = PagePool::CHUNK_PAGES; // unused in the last chunk
+		size_t m_in_use = 0;
+	};
+}
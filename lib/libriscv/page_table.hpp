@@ -0,0 +1,123 @@
+#pragma once
+#include "page.hpp"
+#include <array>
+
+namespace riscv
+{
+	// Maps page numbers to pages through a radix tree indexed directly by
+	// the page number, so there is no hashing. RV32 has two levels, and a
+	// lookup is two dependent loads. Wider addresses get more levels,
+	// which stay sparse as nodes are only created when they are needed.
+	template <int W>
+	struct PageTable
+	{
+		using address_t = address_type<W>;
+		static constexpr unsigned PAGENO_BITS = sizeof(address_t) * 8 - Page::SHIFT;
+		static constexpr unsigned LEVEL_BITS  = 10;
+		static constexpr unsigned LEVELS = (PAGENO_BITS + LEVEL_BITS - 1) / LEVEL_BITS;
+
+		// returns nullptr when there is no page
+		Page* find(address_t pageno) const noexcept {
+			const Node* node = &m_root;
+			for (unsigned level = LEVELS-1; level > 0; level--) {
+				node = node->entry[index(pageno, level)].node;
+				if (node == nullptr) return nullptr;
+			}
+			return node->entry[index(pageno, 0)].page;
+		}
+		// inserts @page unless there is a page already,
+		// and returns the page that is there now
+		Page* insert(address_t pageno, Page* page) {
+			auto& entry = this->leaf(pageno);
+			if (entry.page == nullptr) {
+				entry.page = page;
+				m_size++;
+			}
+			return entry.page;
+		}
+		void erase(address_t pageno) noexcept {
+			Node* node = &m_root;
+			for (unsigned level = LEVELS-1; level > 0; level--) {
+				node = node->entry[index(pageno, level)].node;
+				if (node == nullptr) return;
+			}
+			auto& entry = node->entry[index(pageno, 0)];
+			if (entry.page != nullptr) {
+				entry.page = nullptr;
+				m_size--;
+			}
+		}
+		size_t size() const noexcept { return m_size; }
+
+		// calls @func(pageno, Page*) for every page, in address order
+		template <typename Func>
+		void for_each(Func func) const {
+			visit(m_root, LEVELS-1, 0, func);
+		}
+		void clear() noexcept {
+			release(m_root, LEVELS-1);
+			m_root = {};
+			m_size = 0;
+		}
+
+		PageTable() = default;
+		// the pages themselves are not copied
+		PageTable(const PageTable& other) { *this = other; }
+		PageTable& operator= (const PageTable& other) {
+			if (this != &other) {
+				this->clear();
+				other.for_each([this] (address_t pageno, Page* page) {
+					this->insert(pageno, page);
+				});
+			}
+			return *this;
+		}
+		~PageTable() { release(m_root, LEVELS-1); }
+
+	private:
+		struct Node;
+		union Entry {
+			Node* node;
+			Page* page;
+		};
+		struct Node {
+			std::array<Entry, 1u << LEVEL_BITS> entry {};
+		};
+		static size_t index(address_t pageno, unsigned level) noexcept {
+			return (pageno >> (level * LEVEL_BITS)) & ((1u << LEVEL_BITS) - 1);
+		}
+		Entry& leaf(address_t pageno) {
+			Node* node = &m_root;
+			for (unsigned level = LEVELS-1; level > 0; level--) {
+				auto& next = node->entry[index(pageno, level)].node;
+				if (next == nullptr) next = new Node;
+				node = next;
+			}
+			return node->entry[index(pageno, 0)];
+		}
+		template <typename Func>
+		static void visit(const Node& node, unsigned level, address_t base, Func& func) {
+			for (size_t i = 0; i < node.entry.size(); i++) {
+				const address_t pageno = base | ((address_t) i << (level * LEVEL_BITS));
+				if (level == 0) {
+					if (node.entry[i].page != nullptr) func(pageno, node.entry[i].page);
+				} else if (node.entry[i].node != nullptr) {
+					visit(*node.entry[i].node, level-1, pageno, func);
+				}
+			}
+		}
+		static void release(Node& node, unsigned level) noexcept {
+			if (level == 0) return;
+			for (auto& entry : node.entry) {
+				if (entry.node != nullptr) {
+					release(*entry.node, level-1);
+					delete entry.node;
+					entry.node = nullptr;
+				}
+			}
+		}
+
+		Node   m_root;
+		size_t m_size = 0;
+	};
+}
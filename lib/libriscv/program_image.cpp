@@ -0,0 +1,85 @@
+#include "program_image.hpp"
+#include "machine.hpp"
+#include <cstring>
+
+namespace riscv
+{
+	template <int W>
+	ProgramImage<W>::ProgramImage(std::vector<uint8_t> bin, MachineOptions options)
+		: ProgramImage(BinaryView::adopt(std::move(bin)), std::move(options)) {}
+
+	template <int W>
+	ProgramImage<W>::ProgramImage(BinaryView bin, MachineOptions options)
+		: binary{std::move(bin)}
+	{
+		// translations are loaded by each machine
+		options.translation.clear();
+		// load the program into a machine once, and keep what it made
+		Machine<W> machine { this->binary, options };
+#ifdef RISCV_INSTR_CACHE
+		machine.cpu.decode_execute_segment();
+#endif
+		// the pages are copied, as they can be in the flat memory of the
+		// machine, except pages mapped from the binary, which it keeps alive
+		machine.memory.pages().for_each([this] (address_t pageno, Page* page) {
+			Page* copy = nullptr;
+			if (!page->attr.shared) {
+				copy = new Page { page->attr, page->page() };
+			} else if (!page->m_owns_data && page != &Page::guard_page()
+				&& !page->is_device()) {
+				copy = new Page { page->page(), page->attr };
+			} else return; // eg. the guard page
+			copy->attr.shared = true;
+			this->pages.emplace_back(pageno, copy);
+		});
+		this->exec = machine.memory.exec_segment();
+		this->start_address = machine.memory.start_address();
+		this->stack_address = machine.memory.stack_initial();
+		this->index_symbols();
+		this->exit_address = this->resolve("_exit");
+	}
+	template <int W>
+	ProgramImage<W>::~ProgramImage()
+	{
+		for (auto& it : pages) delete it.second;
+	}
+
+	template <int W>
+	void ProgramImage<W>::index_symbols()
+	{
+		using Ehdr = typename Elf<W>::Ehdr;
+		using Shdr = typename Elf<W>::Shdr;
+		using Sym  = typename Elf<W>::Sym;
+		if (binary.empty()) return;
+		const auto* elf = (const Ehdr*) binary.data();
+		const auto* shdr = (const Shdr*) &binary.at(elf->e_shoff);
+		const char* names = (const char*) &binary.at(shdr[elf->e_shstrndx].sh_offset);
+
+		const Shdr* symtab = nullptr;
+		const Shdr* strtab = nullptr;
+		for (size_t i = 0; i < elf->e_shnum; i++) {
+			const char* name = &names[shdr[i].sh_name];
+			if (strcmp(name, ".symtab") == 0) symtab = &shdr[i];
+			else if (strcmp(name, ".strtab") == 0) strtab = &shdr[i];
+		}
+		if (symtab == nullptr || strtab == nullptr) return;
+
+		const auto* syms = (const Sym*) &binary.at(symtab->sh_offset);
+		const char* strings = (const char*) &binary.at(strtab->sh_offset);
+		const size_t count = symtab->sh_size / sizeof(Sym);
+		m_symbols.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			// the first symbol with a name wins, as in the symtab search
+			m_symbols.emplace(&strings[syms[i].st_name], syms[i].st_value);
+		}
+	}
+
+	template <int W>
+	address_type<W> ProgramImage<W>::resolve(const char* name) const
+	{
+		const auto it = m_symbols.find(name);
+		return (it != m_symbols.end()) ? it->second : 0x0;
+	}
+
+	template struct ProgramImage<4>;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "memory.hpp"
+#include <string_view>
+#include <unordered_map>
+
+namespace riscv
+{
+	// A program that is loaded once, for any number of machines. Every
+	// machine shares the pages of the program, and writable pages are
+	// copied by the machines that write to them. The execute segment is
+	// decoded up front, so that its decoder cache can be shared as well,
+	// and symbols are looked up in an index instead of the ELF symtab.
+	template <int W>
+	struct ProgramImage
+	{
+		using address_t = address_type<W>;
+
+		// @options decide how the program is loaded, and the
+		// memory limit must have room for the whole program
+		ProgramImage(std::vector<uint8_t> binary, MachineOptions options = {});
+		// the binary must outlive the image, unless it has an owner,
+		// eg. a mapped file, whose read-only pages are then shared
+		ProgramImage(BinaryView binary, MachineOptions options = {});
+		ProgramImage(const ProgramImage&) = delete;
+		ProgramImage& operator= (const ProgramImage&) = delete;
+		~ProgramImage();
+
+		// returns the address of a symbol, or zero
+		address_t resolve(const char* name) const;
+
+		const BinaryView binary;
+		// shared pages by page number, owned by the image
+		std::vector<std::pair<address_t, Page*>> pages;
+		ExecSegment<W> exec;
+		address_t start_address = 0;
+		address_t stack_address = 0;
+		address_t exit_address  = 0;
+
+	private:
+		void index_symbols();
+		// names point into the symbol string table of the binary
+		std::unordered_map<std::string_view, address_t> m_symbols;
+	};
+}
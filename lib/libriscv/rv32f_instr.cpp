@@ -1,5 +1,6 @@
 #include "rvfd.hpp"
 #include "instr_helpers.hpp"
+#include <cmath>
 
 namespace riscv
 {
@@ -609,4 +610,70 @@ namespace riscv
 						RISCV::regname(fi.R4type.rs1),
 						RISCV::flpname(fi.R4type.rd));
 	});
+
+	// Specialized handlers for single and double precision, selected
+	// by the decoder. They share the printers of the generic handlers.
+	FLOAT_INSTR(FLW,
+	[] (auto& cpu, rv32i_instruction instr) {
+		rv32f_instruction fi { instr };
+		const auto addr = cpu.reg(fi.Itype.rs1) + fi.Itype.signed_imm();
+		cpu.registers().getfl(fi.Itype.rd).load_u32(
+			cpu.machine().memory.template read<uint32_t> (addr));
+	}, DECODED_FLOAT(FLW_FLD).printer);
+	FLOAT_INSTR(FLD,
+	[] (auto& cpu, rv32i_instruction instr) {
+		rv32f_instruction fi { instr };
+		const auto addr = cpu.reg(fi.Itype.rs1) + fi.Itype.signed_imm();
+		cpu.registers().getfl(fi.Itype.rd).load_u64(
+			cpu.machine().memory.template read<uint64_t> (addr));
+	}, DECODED_FLOAT(FLW_FLD).printer);
+	FLOAT_INSTR(FSW,
+	[] (auto& cpu, rv32i_instruction instr) {
+		rv32f_instruction fi { instr };
+		const auto addr = cpu.reg(fi.Stype.rs1) + fi.Stype.signed_imm();
+		cpu.machine().memory.template write<uint32_t> (addr,
+			cpu.registers().getfl(fi.Stype.rs2).i32[0]);
+	}, DECODED_FLOAT(FSW_FSD).printer);
+	FLOAT_INSTR(FSD,
+	[] (auto& cpu, rv32i_instruction instr) {
+		rv32f_instruction fi { instr };
+		const auto addr = cpu.reg(fi.Stype.rs1) + fi.Stype.signed_imm();
+		cpu.machine().memory.template write<uint64_t> (addr,
+			cpu.registers().getfl(fi.Stype.rs2).i64);
+	}, DECODED_FLOAT(FSW_FSD).printer);
+
+#define FLOAT_OP_INSTR(x, load, operation)                               \
+	FLOAT_INSTR(x##_S,                                                   \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		rv32f_instruction fi { instr };                                  \
+		auto& dst = cpu.registers().getfl(fi.R4type.rd);                 \
+		load(f32[0]);                                                    \
+		dst.f32[0] = (operation);                                        \
+		dst.nanbox();                                                    \
+	}, DECODED_FLOAT(x).printer);                                        \
+	FLOAT_INSTR(x##_D,                                                   \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		rv32f_instruction fi { instr };                                  \
+		auto& dst = cpu.registers().getfl(fi.R4type.rd);                 \
+		load(f64);                                                       \
+		dst.f64 = (operation);                                           \
+	}, DECODED_FLOAT(x).printer)
+#define FLOAT_LOAD2(field)                                               \
+		const auto rs1 = cpu.registers().getfl(fi.R4type.rs1).field;     \
+		const auto rs2 = cpu.registers().getfl(fi.R4type.rs2).field
+#define FLOAT_LOAD3(field)                                               \
+		FLOAT_LOAD2(field);                                              \
+		const auto rs3 = cpu.registers().getfl(fi.R4type.rs3).field
+
+	FLOAT_OP_INSTR(FMADD,  FLOAT_LOAD3, rs1 * rs2 + rs3);
+	FLOAT_OP_INSTR(FMSUB,  FLOAT_LOAD3, rs1 * rs2 - rs3);
+	FLOAT_OP_INSTR(FNMADD, FLOAT_LOAD3, -(rs1 * rs2) - rs3);
+	FLOAT_OP_INSTR(FNMSUB, FLOAT_LOAD3, -(rs1 * rs2) + rs3);
+	FLOAT_OP_INSTR(FADD,   FLOAT_LOAD2, rs1 + rs2);
+	FLOAT_OP_INSTR(FSUB,   FLOAT_LOAD2, rs1 - rs2);
+	FLOAT_OP_INSTR(FMUL,   FLOAT_LOAD2, rs1 * rs2);
+	FLOAT_OP_INSTR(FDIV,   FLOAT_LOAD2, rs1 / rs2);
+#undef FLOAT_LOAD3
+#undef FLOAT_LOAD2
+#undef FLOAT_OP_INSTR
 }
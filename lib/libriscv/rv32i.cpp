@@ -6,6 +6,9 @@
 #endif
 #include "rv32c_instr.cpp"
 #include "rv32f_instr.cpp"
+#ifdef RISCV_INSTR_CACHE
+#include "rv32i_fused.cpp"
+#endif
 
 namespace riscv
 {
@@ -25,6 +28,157 @@ namespace riscv
 #undef DECODER
 	}
 
+#ifdef RISCV_INSTR_CACHE
+	// the index of every decoded instruction in the handler table
+#define HANDLER_INDEX(x) x##_index
+	enum : uint16_t {
+		NOT_DECODED = 0,
+#define INSTRUCTION_LIST(x) HANDLER_INDEX(x),
+#include "rv32_instr_list.inc"
+#undef INSTRUCTION_LIST
+		FUSED_HANDLERS
+	};
+	static constexpr size_t DECODED_HANDLERS = FUSED_HANDLERS - 1;
+	static constexpr auto handler_table = [] {
+		std::array<RV32I::handler_t, DECODED_HANDLERS + fused::handlers.size()> table {};
+		const RV32I::handler_t decoded[] = {
+#define INSTRUCTION_LIST(x) x.handler,
+#include "rv32_instr_list.inc"
+#undef INSTRUCTION_LIST
+		};
+		// index zero is never decoded, and neither is fused pair zero
+		size_t i = 1;
+		for (const auto handler : decoded)
+			table[i++] = handler;
+		for (size_t f = 1; f < fused::handlers.size(); f++)
+			table[i++] = fused::handlers[f];
+		return table;
+	}();
+	const RV32I::handler_t* const RV32I::handlers = handler_table.data();
+
+	uint16_t RV32I::handler_index(const format_t instruction)
+	{
+#define DECODER(x) return HANDLER_INDEX(x)
+#include "rv32_instr.inc"
+#undef DECODER
+	}
+	uint16_t RV32I::handler_index(uint8_t fused)
+	{
+		return DECODED_HANDLERS + fused;
+	}
+#undef HANDLER_INDEX
+#endif
+
+#ifdef RISCV_THREADED
+#define THREADED_LABEL(x) riscv_threaded_##x
+	template<> __attribute__((hot))
+	void CPU<4>::simulate_block(const uint64_t max_counter)
+	{
+#ifdef RISCV_BINARY_TRANSLATION
+		if (m_translation.simulate(*this, max_counter)) return;
+#endif
+#ifdef RISCV_JIT
+		if (m_jit.simulate(*this, max_counter)) return;
+#endif
+		constexpr size_t DIVISOR = DecoderCache<Page::SIZE>::DIVISOR;
+		const auto view = this->code_view();
+		const auto* entry = &view.cache[view.offset / DIVISOR];
+		const uint8_t* code = &view.code[view.offset];
+
+		if (UNLIKELY(entry->handler == 0)) {
+			this->decode_block(view);
+		}
+		// the label of every decoded instruction, by handler index
+		static const void* const labels[] = {
+			nullptr,
+#define INSTRUCTION_LIST(x) &&THREADED_LABEL(x),
+#include "rv32_instr_list.inc"
+#undef INSTRUCTION_LIST
+		};
+		// see the comments in CPU::simulate_block()
+		if (UNLIKELY(entry->handler == 0
+			|| entry->block_length > max_counter - m_counter)) {
+			this->simulate();
+			return;
+		}
+		unsigned remaining = entry->block_length;
+		this->increment_counter(remaining - 1);
+		format_t instruction;
+		unsigned length;
+		unsigned handler;
+		try {
+		// every handler jumps directly to the next handler in the block
+#define THREADED_DISPATCH()                                            \
+			length  = entry->length;                                   \
+			handler = entry->handler;                                  \
+			instruction = this->cached_instruction(code, length);      \
+			{                                                          \
+				const void* label = (handler <= DECODED_HANDLERS)      \
+					? labels[handler] : &&riscv_threaded_fused;        \
+				entry += length / DIVISOR;                             \
+				code  += length;                                       \
+				goto *label;                                           \
+			}
+			THREADED_DISPATCH();
+#define INSTRUCTION_LIST(x)                       \
+		THREADED_LABEL(x):                        \
+			x.handler(*this, instruction);        \
+			registers().pc += length;             \
+			if (LIKELY(--remaining != 0)) {       \
+				THREADED_DISPATCH();              \
+			}                                     \
+			goto riscv_threaded_done;
+#include "rv32_instr_list.inc"
+#undef INSTRUCTION_LIST
+		riscv_threaded_fused:
+			handler_table[handler](*this, instruction);
+			registers().pc += length;
+			remaining -= 2;
+			if (LIKELY(remaining != 0)) {
+				THREADED_DISPATCH();
+			}
+#undef THREADED_DISPATCH
+		riscv_threaded_done:;
+		} catch (...) {
+			// see the comments in CPU::simulate_block()
+			if constexpr (counter_enabled)
+				this->m_counter -= remaining - 1;
+			throw;
+		}
+		this->increment_counter(1);
+	}
+#undef THREADED_LABEL
+#endif
+
+	bool RV32I::is_block_end(const format_t instruction)
+	{
+		if constexpr (compressed_enabled) {
+			if (!instruction.is_long()) {
+				const auto ci = instruction.compressed();
+				switch (ci.opcode()) {
+					case CI_CODE(0b001, 0b01): // C.JAL
+					case CI_CODE(0b101, 0b01): // C.JMP
+					case CI_CODE(0b110, 0b01): // C.BEQZ
+					case CI_CODE(0b111, 0b01): // C.BNEZ
+						return true;
+					case CI_CODE(0b100, 0b10): // C.JR, C.JALR and C.EBREAK
+						return ci.CR.rs2 == 0;
+				}
+				return false;
+			}
+		}
+		switch (instruction.opcode()) {
+			case 0b1100011: // BRANCH
+			case 0b1100111: // JALR
+			case 0b1101111: // JAL
+			case 0b1110011: // SYSTEM
+				return true;
+			case 0b0001111: // FENCE.I
+				return instruction.Itype.funct3 == 0x1;
+		}
+		return false;
+	}
+
 	std::string RV32I::to_string(CPU<4>& cpu, format_t format, const instruction_t& instr)
 	{
 		char buffer[256];
@@ -48,3 +202,9 @@ namespace riscv
 		return std::string(buffer, len);
 	}
 }
+#ifdef RISCV_JIT
+#include "rv32i_jit.cpp"
+#endif
+#ifdef RISCV_BINARY_TRANSLATION
+#include "rv32i_translation.cpp"
+#endif
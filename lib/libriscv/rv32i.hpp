@@ -16,11 +16,26 @@ namespace riscv
 		using register_t    = uint32_t;
 
 		static std::string to_string(CPU<4>& cpu, format_t format, const instruction_t& instr);
+		// true for instructions that can change the PC, leave the machine,
+		// or make instruction fetch see new code (FENCE.I)
+		static bool is_block_end(format_t format);
+		// macro-op fusion of common instruction pairs: returns the index of
+		// the fused pair and its operands, or zero (see rv32i_fused.cpp)
+		static uint8_t fuse(format_t first, format_t second, uint32_t& operands);
+		// the operands of the fused pair of @length bytes at @code
+		static uint32_t fused_operands(const uint8_t* code, unsigned length);
+		// the decoder cache refers to handlers by their index in this table,
+		// which has every decoded instruction followed by the fused pairs
+		using handler_t = void (*)(CPU<4>&, format_t);
+		static const handler_t* const handlers;
+		static uint16_t handler_index(format_t); // decodes the instruction
+		static uint16_t handler_index(uint8_t fused);
 
 		static inline uint32_t SRA(bool is_signed, uint32_t shifts, uint32_t value)
 		{
 			const uint32_t sign_bits = -is_signed ^ 0x0;
-			const uint32_t sign_shifted = sign_bits << (32 - shifts);
+			// nothing is shifted in when nothing is shifted
+			const uint32_t sign_shifted = (shifts != 0) ? sign_bits << (32 - shifts) : 0;
 			return (value >> shifts) | sign_shifted;
 		}
 	};
@@ -0,0 +1,175 @@
+#include "rv32i.hpp"
+#include "instr_helpers.hpp"
+#include <cstring>
+#include <utility>
+
+namespace riscv
+{
+	// Fused instruction pairs are installed by the decoder cache in place
+	// of the first instruction, and always execute both instructions.
+	// The operands are computed from the pair into the instruction bits
+	// (see fused_operands()), and when there is no room left the destination
+	// register becomes a template argument. None of them can fault, except LOAD_GLOBAL which takes
+	// care to fault on the second instruction of the pair.
+	namespace fused
+	{
+		enum : int {
+			LI = 0,      // LUI rd, hi  + ADDI rd, rd, lo
+			CALL,        // AUIPC rd, hi + JALR rd, lo(rd)
+			TAIL,        // AUIPC rd, hi + JALR x0, lo(rd)
+			LOAD_GLOBAL, // AUIPC rd, hi + LW rd, lo(rd)
+			SLT_BRANCH,  // SLT(U) rd, rs1, rs2 + BEQ/BNE rd, x0 (or C.BEQZ/C.BNEZ)
+		};
+		static constexpr uint8_t index(int kind, unsigned rd) {
+			return 1 + kind * 32 + rd;
+		}
+
+		// split a PC-relative offset back into its AUIPC and 12-bit parts
+		static inline int32_t lower12(uint32_t offset) {
+			return (int32_t) (offset << 20) >> 20;
+		}
+		static inline uint32_t upper20(uint32_t offset) {
+			return offset - lower12(offset);
+		}
+
+		template <int RD>
+		struct Handlers
+		{
+			static void li(CPU<4>& cpu, rv32i_instruction instr) {
+				cpu.reg(RD) = instr.whole;
+			}
+			static void call(CPU<4>& cpu, rv32i_instruction instr) {
+				cpu.reg(RD) = cpu.pc() + 8;
+				cpu.jump(cpu.pc() + instr.whole - 8);
+			}
+			static void tail(CPU<4>& cpu, rv32i_instruction instr) {
+				cpu.reg(RD) = cpu.pc() + upper20(instr.whole);
+				cpu.jump(cpu.pc() + instr.whole - 8);
+			}
+			static void load_global(CPU<4>& cpu, rv32i_instruction instr) {
+				const uint32_t addr = cpu.pc() + instr.whole;
+				try {
+					cpu.reg(RD) = cpu.machine().memory.template read<uint32_t>(addr);
+				} catch (...) {
+					// complete the AUIPC, and let the LW be the faulting instruction
+					cpu.reg(RD) = cpu.pc() + upper20(instr.whole);
+					cpu.registers().pc += 4;
+					cpu.increment_counter(1);
+					throw;
+				}
+			}
+		};
+
+		// bits 0-14: rd, rs1, rs2, 15: unsigned, 16: branch when not zero,
+		// 17: the branch is compressed, 18-31: branch offset
+		static void slt_branch(CPU<4>& cpu, rv32i_instruction instr)
+		{
+			const uint32_t bits = instr.whole;
+			const uint32_t src1 = cpu.reg((bits >> 5) & 0x1F);
+			const uint32_t src2 = cpu.reg((bits >> 10) & 0x1F);
+			const bool less = (bits & (1u << 15))
+				? (src1 < src2) : ((int32_t) src1 < (int32_t) src2);
+			cpu.reg(bits & 0x1F) = less;
+			if (less == ((bits & (1u << 16)) != 0)) {
+				const int32_t branch_length = (bits & (1u << 17)) ? 2 : 4;
+				cpu.jump(cpu.pc() + ((int32_t) bits >> 18) - branch_length);
+			}
+		}
+
+		template <size_t... RD>
+		static constexpr auto make_handlers(std::index_sequence<RD...>)
+		{
+			return std::array<RV32I::handler_t, 2 + 4 * sizeof...(RD)> {
+				nullptr,
+				&Handlers<RD>::li...,
+				&Handlers<RD>::call...,
+				&Handlers<RD>::tail...,
+				&Handlers<RD>::load_global...,
+				&slt_branch
+			};
+		}
+		static constexpr auto handlers = make_handlers(std::make_index_sequence<32>{});
+		static_assert(handlers.size() == index(SLT_BRANCH, 0) + 1);
+	}
+
+	uint8_t RV32I::fuse(const format_t first, const format_t second, uint32_t& operands)
+	{
+		using namespace fused;
+		// jump targets are known in advance, and are never fused when misaligned
+		constexpr uint32_t ALIGN_MASK = (compressed_enabled) ? 0x1 : 0x3;
+
+		switch (first.opcode()) {
+		case 0b0110111: { // LUI
+			const unsigned rd = first.Utype.rd;
+			if (rd != 0 && second.opcode() == 0b0010011 // ADDI
+				&& second.Itype.funct3 == 0x0
+				&& second.Itype.rd == rd && second.Itype.rs1 == rd)
+			{
+				operands = first.Utype.upper_imm() + second.Itype.signed_imm();
+				return index(LI, rd);
+			}
+			return 0;
+		}
+		case 0b0010111: { // AUIPC
+			const unsigned rd = first.Utype.rd;
+			if (rd == 0 || !second.is_long() || second.Itype.rs1 != rd)
+				return 0;
+			operands = first.Utype.upper_imm() + second.Itype.signed_imm();
+			if (second.opcode() == 0b1100111) { // JALR
+				if (operands & ALIGN_MASK) return 0;
+				if (second.Itype.rd == rd) return index(CALL, rd);
+				if (second.Itype.rd == 0)  return index(TAIL, rd);
+			}
+			else if (second.opcode() == 0b0000011 // LW
+				&& second.Itype.funct3 == 0x2 && second.Itype.rd == rd) {
+				return index(LOAD_GLOBAL, rd);
+			}
+			return 0;
+		}
+		case 0b0110011: { // SLT, SLTU
+			const unsigned rd = first.Rtype.rd;
+			if (rd == 0 || first.Rtype.funct7 != 0
+				|| (first.Rtype.funct3 != 0x2 && first.Rtype.funct3 != 0x3))
+				return 0;
+			uint32_t bits = rd | (first.Rtype.rs1 << 5) | (first.Rtype.rs2 << 10)
+				| ((first.Rtype.funct3 & 1) << 15);
+			int32_t offset;
+			if (second.is_long()) {
+				if (second.opcode() != 0b1100011) return 0; // BRANCH
+				const bool compares_rd =
+					(second.Btype.rs1 == rd && second.Btype.rs2 == 0) ||
+					(second.Btype.rs1 == 0 && second.Btype.rs2 == rd);
+				if (!compares_rd || second.Btype.funct3 > 0x1) return 0;
+				bits |= (second.Btype.funct3 & 1) << 16; // BNE
+				offset = second.Btype.signed_imm();
+			} else if constexpr (compressed_enabled) {
+				const auto ci = second.compressed();
+				if (ci.opcode() != CI_CODE(0b110, 0b01) && ci.opcode() != CI_CODE(0b111, 0b01))
+					return 0; // C.BEQZ, C.BNEZ
+				if (ci.CB.srs1 + 0x8u != rd) return 0;
+				bits |= (ci.opcode() == CI_CODE(0b111, 0b01)) << 16;
+				bits |= 1u << 17;
+				offset = ci.CB.signed_imm();
+			} else {
+				return 0;
+			}
+			if (offset & ALIGN_MASK) return 0;
+			operands = bits | ((uint32_t) offset << 18);
+			return index(SLT_BRANCH, 0);
+		}
+		}
+		return 0;
+	}
+
+	uint32_t RV32I::fused_operands(const uint8_t* code, unsigned length)
+	{
+		// pairs are fused again, as the operands are not kept
+		format_t first, second;
+		std::memcpy(&first.whole, code, 4);
+		second.whole = 0;
+		std::memcpy(&second.whole, code + 4, length - 4);
+		uint32_t operands = 0;
+		fuse(first, second, operands);
+		return operands;
+	}
+}
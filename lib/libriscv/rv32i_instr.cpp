@@ -541,4 +541,133 @@ namespace riscv
 		// printer
 		return snprintf(buffer, len, "FENCE");
 	});
+
+	INSTRUCTION(FENCE_I,
+	[] (auto& cpu, rv32i_instruction /* instr */) {
+		// instruction fetch must see every earlier write
+		cpu.machine().memory.invalidate_decoder_caches();
+	},
+	[] (char* buffer, size_t len, auto&, rv32i_instruction) -> int {
+		// printer
+		return snprintf(buffer, len, "FENCE.I");
+	});
+
+	// Specialized handlers, one per concrete operation. The decoder picks
+	// them over the generic handlers above, so that there is no switch on
+	// funct3/funct7 when executing. They share the generic printers.
+	INSTRUCTION(NOP,
+	[] (auto&, rv32i_instruction) {
+		// the result would be written to x0
+	},
+	[] (char* buffer, size_t len, auto&, rv32i_instruction) -> int {
+		return snprintf(buffer, len, "NOP");
+	});
+
+#define LOAD_INSTR(x, type, cast)                                        \
+	INSTRUCTION(x,                                                       \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		const auto addr = cpu.reg(instr.Itype.rs1) + instr.Itype.signed_imm(); \
+		cpu.reg(instr.Itype.rd) =                                        \
+			(cast) cpu.machine().memory.template read<type>(addr);      \
+	}, DECODED_INSTR(LOAD).printer)
+
+	LOAD_INSTR(LB,  uint8_t,  int8_t);
+	LOAD_INSTR(LH,  uint16_t, int16_t);
+	LOAD_INSTR(LW,  uint32_t, uint32_t);
+	LOAD_INSTR(LBU, uint8_t,  uint8_t);
+	LOAD_INSTR(LHU, uint16_t, uint16_t);
+#undef LOAD_INSTR
+
+#define STORE_INSTR(x, type)                                             \
+	INSTRUCTION(x,                                                       \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		const auto addr = cpu.reg(instr.Stype.rs1) + instr.Stype.signed_imm(); \
+		cpu.machine().memory.template write<type>(addr, cpu.reg(instr.Stype.rs2)); \
+	}, DECODED_INSTR(STORE).printer)
+
+	STORE_INSTR(SB, uint8_t);
+	STORE_INSTR(SH, uint16_t);
+	STORE_INSTR(SW, uint32_t);
+#undef STORE_INSTR
+
+#define BRANCH_INSTR(x, comparison)                                      \
+	INSTRUCTION(x,                                                       \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		const auto reg1 = cpu.reg(instr.Btype.rs1);                      \
+		const auto reg2 = cpu.reg(instr.Btype.rs2);                      \
+		if (comparison) {                                                \
+			cpu.jump(cpu.pc() + instr.Btype.signed_imm() - 4);           \
+			if (UNLIKELY(cpu.machine().verbose_jumps)) {                 \
+				printf(">>> BRANCH jump to 0x%X\n", cpu.pc() + 4);       \
+			}                                                            \
+		}                                                                \
+	}, DECODED_INSTR(BRANCH).printer)
+
+	BRANCH_INSTR(BEQ,  reg1 == reg2);
+	BRANCH_INSTR(BNE,  reg1 != reg2);
+	BRANCH_INSTR(BLT,  instr.to_signed(reg1) < instr.to_signed(reg2));
+	BRANCH_INSTR(BGE,  instr.to_signed(reg1) >= instr.to_signed(reg2));
+	BRANCH_INSTR(BLTU, reg1 < reg2);
+	BRANCH_INSTR(BGEU, reg1 >= reg2);
+#undef BRANCH_INSTR
+
+#define OP_IMM_INSTR(x, operation)                                       \
+	INSTRUCTION(x,                                                       \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		const auto src = cpu.reg(instr.Itype.rs1);                       \
+		cpu.reg(instr.Itype.rd) = (operation);                           \
+	}, DECODED_INSTR(OP_IMM).printer)
+
+	OP_IMM_INSTR(ADDI,  src + instr.Itype.signed_imm());
+	OP_IMM_INSTR(SLLI,  src << instr.Itype.shift_imm());
+	OP_IMM_INSTR(SLTI,  (instr.to_signed(src) < instr.Itype.signed_imm()) ? 1 : 0);
+	OP_IMM_INSTR(SLTIU, (src < (unsigned) instr.Itype.signed_imm()) ? 1 : 0);
+	OP_IMM_INSTR(XORI,  src ^ instr.Itype.signed_imm());
+	OP_IMM_INSTR(SRLI,  src >> instr.Itype.shift_imm());
+	OP_IMM_INSTR(SRAI,  RV32I::SRA(src & 0x80000000, instr.Itype.shift_imm(), src));
+	OP_IMM_INSTR(ORI,   src | instr.Itype.signed_imm());
+	OP_IMM_INSTR(ANDI,  src & instr.Itype.signed_imm());
+#undef OP_IMM_INSTR
+
+	// ADDI rd, x0, imm
+	INSTRUCTION(LI,
+	[] (auto& cpu, rv32i_instruction instr) {
+		cpu.reg(instr.Itype.rd) = instr.Itype.signed_imm();
+	}, DECODED_INSTR(OP_IMM).printer);
+
+#define OP_INSTR(x, operation)                                           \
+	INSTRUCTION(x,                                                       \
+	[] (auto& cpu, rv32i_instruction instr) {                            \
+		const auto src1 = cpu.reg(instr.Rtype.rs1);                      \
+		const auto src2 = cpu.reg(instr.Rtype.rs2);                      \
+		auto& dst = cpu.reg(instr.Rtype.rd);                             \
+		operation;                                                       \
+	}, DECODED_INSTR(OP).printer)
+
+	OP_INSTR(ADD,  dst = src1 + src2);
+	OP_INSTR(SUB,  dst = src1 - src2);
+	OP_INSTR(SLL,  dst = src1 << (src2 & 0x1F));
+	OP_INSTR(SLT,  dst = (instr.to_signed(src1) < instr.to_signed(src2)) ? 1 : 0);
+	OP_INSTR(SLTU, dst = (src1 < src2) ? 1 : 0);
+	OP_INSTR(XOR,  dst = src1 ^ src2);
+	OP_INSTR(SRL,  dst = src1 >> (src2 & 0x1F));
+	OP_INSTR(SRA,  dst = RV32I::SRA(src1 & 0x80000000, src2 & 0x1F, src1));
+	OP_INSTR(OR,   dst = src1 | src2);
+	OP_INSTR(AND,  dst = src1 & src2);
+	// extension RV32M, see the generic OP handler for the corner cases
+	OP_INSTR(MUL,    dst = instr.to_signed(src1) * instr.to_signed(src2));
+	OP_INSTR(MULH,   dst = ((int64_t) src1 * (int64_t) src2) >> 32u);
+	OP_INSTR(MULHSU, dst = ((int64_t) src1 * (uint64_t) src2) >> 32u);
+	OP_INSTR(MULHU,  dst = ((uint64_t) src1 * (uint64_t) src2) >> 32u);
+	OP_INSTR(DIV,
+		if (LIKELY(src2 != 0 && !(src1 == 2147483648 && src2 == 4294967295)))
+			dst = instr.to_signed(src1) / instr.to_signed(src2));
+	OP_INSTR(DIVU,
+		if (LIKELY(src2 != 0)) dst = src1 / src2);
+	OP_INSTR(REM,
+		if (LIKELY(src2 != 0 && !(src1 == 2147483648 && src2 == 4294967295)))
+			dst = instr.to_signed(src1) % instr.to_signed(src2));
+	OP_INSTR(REMU,
+		if (LIKELY(src2 != 0)) dst = src1 % src2);
+#undef OP_INSTR
 }
@@ -0,0 +1,469 @@
+#include "rv32i.hpp"
+#include "instr_helpers.hpp"
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace riscv
+{
+	// The translator works on one straight-line block at a time. Guest
+	// registers stay in memory (RBX points to x0), and every instruction
+	// mirrors its interpreter handler exactly. Loads, stores and anything
+	// not translated inline call back into C++ with the PC written back,
+	// and on an exception native code stops before the instruction that
+	// faulted, as the interpreter would. Control flow that needs the
+	// machine (system calls, FENCE.I, compressed jumps) ends the native
+	// block, and the interpreter continues from there.
+	namespace jit
+	{
+		using State = Jit<4>::State;
+
+		// just enough of an x86-64 assembler for the translator
+		struct Assembler
+		{
+			enum Reg : uint8_t { EAX = 0, ECX = 1, EDX = 2 };
+			enum Cond : uint8_t { B = 0x2, AE = 0x3, E = 0x4, NE = 0x5, L = 0xC, GE = 0xD };
+
+			uint8_t* code;
+			size_t   size;
+			size_t   pos = 0;
+
+			bool overflow() const noexcept { return pos > size; }
+			void byte(uint8_t b) {
+				if (pos < size) code[pos] = b;
+				pos++;
+			}
+			void dword(uint32_t v) {
+				for (int i = 0; i < 4; i++) byte(v >> (8 * i));
+			}
+			void qword(uint64_t v) {
+				dword(v); dword(v >> 32);
+			}
+			// [rbx + disp], where the guest registers are
+			void modrm_regs(unsigned r, int32_t disp) {
+				if (disp >= -128 && disp < 128) {
+					byte(0x43 | (r << 3)); byte(disp);
+				} else {
+					byte(0x83 | (r << 3)); dword(disp);
+				}
+			}
+			void load(Reg r, int32_t disp)  { byte(0x8B); modrm_regs(r, disp); }
+			void store(int32_t disp, Reg r) { byte(0x89); modrm_regs(r, disp); }
+			void store_imm(int32_t disp, uint32_t imm) {
+				byte(0xC7); modrm_regs(0, disp); dword(imm);
+			}
+			void mov_imm(Reg r, uint32_t imm) { byte(0xB8 + r); dword(imm); }
+			// ADD 0x01, OR 0x09, AND 0x21, SUB 0x29, XOR 0x31, CMP 0x39
+			void alu(uint8_t op, Reg dst, Reg src) {
+				byte(op); byte(0xC0 | (src << 3) | dst);
+			}
+			// /0 ADD, /1 OR, /4 AND, /6 XOR, /7 CMP
+			void alu_imm(unsigned ext, Reg dst, int32_t imm) {
+				if (imm >= -128 && imm < 128) {
+					byte(0x83); byte(0xC0 | (ext << 3) | dst); byte(imm);
+				} else {
+					byte(0x81); byte(0xC0 | (ext << 3) | dst); dword(imm);
+				}
+			}
+			// /4 SHL, /5 SHR, /7 SAR
+			void shift_imm(unsigned ext, Reg r, uint8_t n) {
+				byte(0xC1); byte(0xC0 | (ext << 3) | r); byte(n);
+			}
+			void shift_cl(unsigned ext, Reg r) {
+				byte(0xD3); byte(0xC0 | (ext << 3) | r);
+			}
+			void imul(Reg dst, Reg src) {
+				byte(0x0F); byte(0xAF); byte(0xC0 | (dst << 3) | src);
+			}
+			void test_imm(Reg r, uint32_t imm) {
+				byte(0xF7); byte(0xC0 | r); dword(imm);
+			}
+			// setcc al + movzx eax, al
+			void set_eax(Cond cc) {
+				byte(0x0F); byte(0x90 | cc); byte(0xC0);
+				byte(0x0F); byte(0xB6); byte(0xC0);
+			}
+			// returns the location of the relative offset, for bind()
+			size_t jcc(Cond cc) {
+				byte(0x0F); byte(0x80 | cc); dword(0);
+				return pos - 4;
+			}
+			size_t jmp() {
+				byte(0xE9); dword(0);
+				return pos - 4;
+			}
+			// make the jump at @at land here
+			void bind(size_t at) {
+				const uint32_t rel = pos - (at + 4);
+				if (at + 4 <= size) std::memcpy(&code[at], &rel, 4);
+			}
+			// first argument is the state (RBP)
+			void call(const void* function) {
+				byte(0x48); byte(0x89); byte(0xEF); // mov rdi, rbp
+				byte(0x48); byte(0xB8); qword((uintptr_t) function); // mov rax, imm64
+				byte(0xFF); byte(0xD0); // call rax
+			}
+			void fault_check() {
+				byte(0x80); byte(0x7D); byte(0x00); byte(0x00); // cmp byte [rbp], 0
+			}
+		};
+
+		template <typename T, typename Cast>
+		static uint32_t load(State* state, uint32_t addr, uint32_t pc) noexcept
+		{
+			auto& cpu = *state->cpu;
+			cpu.registers().pc = pc;
+			try {
+				return (Cast) cpu.machine().memory.template read<T>(addr);
+			} catch (...) {
+				state->fail();
+				return 0;
+			}
+		}
+		template <typename T>
+		static void store(State* state, uint32_t addr, uint32_t value, uint32_t pc) noexcept
+		{
+			auto& cpu = *state->cpu;
+			cpu.registers().pc = pc;
+			try {
+				cpu.machine().memory.template write<T>(addr, value);
+			} catch (...) {
+				state->fail();
+			}
+		}
+		static void handler(State* state, RV32I::handler_t handler,
+			uint32_t instr, uint32_t pc) noexcept
+		{
+			auto& cpu = *state->cpu;
+			cpu.registers().pc = pc;
+			try {
+				handler(cpu, rv32i_instruction { instr });
+			} catch (...) {
+				state->fail();
+			}
+		}
+
+		class Translator
+		{
+		public:
+			Translator(CPU<4>& cpu, uint8_t* code, size_t size)
+				: m_cpu(cpu), m_asm { code, size }
+			{
+				m_pc_disp = (intptr_t) &cpu.registers().pc - (intptr_t) &cpu.reg(0);
+			}
+
+			bool translate(uint32_t pc, unsigned max_instructions);
+
+			size_t size() const noexcept { return m_asm.pos; }
+			bool overflow() const noexcept { return m_asm.overflow(); }
+			unsigned instructions() const noexcept { return m_count; }
+			bool complete() const noexcept { return m_complete; }
+
+		private:
+			static int32_t reg(unsigned idx) { return idx * 4; }
+			void instruction(rv32i_instruction, const CPU<4>::instruction_t&);
+			bool branch(rv32i_instruction, const CPU<4>::instruction_t&);
+			void exit_here();
+			void exit_if_faulted();
+			void finish(uint32_t next_pc);
+
+			CPU<4>&   m_cpu;
+			Assembler m_asm;
+			int32_t   m_pc_disp;
+			uint32_t  m_pc = 0;
+			unsigned  m_count = 0;
+			bool      m_complete = false;
+			std::vector<size_t> m_exits;
+		};
+
+		// stop before the current instruction
+		void Translator::exit_here()
+		{
+			m_asm.store_imm(m_pc_disp, m_pc);
+			m_asm.mov_imm(Assembler::EAX, m_count);
+			m_exits.push_back(m_asm.jmp());
+		}
+		void Translator::exit_if_faulted()
+		{
+			m_asm.fault_check();
+			const size_t ok = m_asm.jcc(Assembler::E);
+			this->exit_here();
+			m_asm.bind(ok);
+		}
+		// the current instruction (a branch) completed, and goes to @next_pc
+		void Translator::finish(uint32_t next_pc)
+		{
+			m_asm.store_imm(m_pc_disp, next_pc);
+			m_asm.mov_imm(Assembler::EAX, m_count + 1);
+			m_exits.push_back(m_asm.jmp());
+		}
+
+		bool Translator::translate(const uint32_t pc, const unsigned max_instructions)
+		{
+			const auto& exec = m_cpu.machine().memory.exec_segment();
+			auto& a = m_asm;
+			// push rbx; push rbp; sub rsp, 8; mov rbx, rdi; mov rbp, rsi
+			for (const uint8_t b : { 0x53, 0x55, 0x48, 0x83, 0xEC, 0x08,
+				0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5 }) a.byte(b);
+
+			m_pc = pc;
+			while (m_count < max_instructions && exec.contains(m_pc))
+			{
+				const rv32i_instruction instr { exec.template read<uint32_t>(m_pc) };
+				const auto& decoded = m_cpu.decode(instr);
+				if (RV32I::is_block_end(instr)) {
+					m_complete = this->branch(instr, decoded);
+					if (m_complete) m_count++;
+					break;
+				}
+				this->instruction(instr, decoded);
+				m_count++;
+				m_pc += (compressed_enabled) ? instr.length() : 4;
+			}
+			if (!m_complete) this->exit_here();
+			for (const size_t at : m_exits) a.bind(at);
+			// add rsp, 8; pop rbp; pop rbx; ret
+			for (const uint8_t b : { 0x48, 0x83, 0xC4, 0x08, 0x5D, 0x5B, 0xC3 })
+				a.byte(b);
+			return m_count != 0;
+		}
+
+		void Translator::instruction(const rv32i_instruction instr,
+			const CPU<4>::instruction_t& decoded)
+		{
+			using A = Assembler;
+			auto& a = m_asm;
+			const auto& I = instr.Itype;
+			const auto& R = instr.Rtype;
+			const auto op_imm = [&] (unsigned ext) {
+				a.load(A::EAX, reg(I.rs1));
+				a.alu_imm(ext, A::EAX, I.signed_imm());
+				a.store(reg(I.rd), A::EAX);
+			};
+			const auto shift_imm = [&] (unsigned ext) {
+				a.load(A::EAX, reg(I.rs1));
+				if (I.shift_imm() != 0) a.shift_imm(ext, A::EAX, I.shift_imm());
+				a.store(reg(I.rd), A::EAX);
+			};
+			const auto set_imm = [&] (A::Cond cc) {
+				a.load(A::EAX, reg(I.rs1));
+				a.alu_imm(7, A::EAX, I.signed_imm());
+				a.set_eax(cc);
+				a.store(reg(I.rd), A::EAX);
+			};
+			const auto op = [&] (auto emit) {
+				a.load(A::EAX, reg(R.rs1));
+				a.load(A::ECX, reg(R.rs2));
+				emit();
+				a.store(reg(R.rd), A::EAX);
+			};
+			const auto load = [&] (const void* function) {
+				a.load(A::EAX, reg(I.rs1));
+				a.alu_imm(0, A::EAX, I.signed_imm());
+				a.byte(0x89); a.byte(0xC6); // mov esi, eax
+				a.mov_imm(A::EDX, m_pc);
+				a.call(function);
+				this->exit_if_faulted();
+				a.store(reg(I.rd), A::EAX);
+			};
+			const auto store = [&] (const void* function) {
+				a.load(A::EAX, reg(instr.Stype.rs1));
+				a.alu_imm(0, A::EAX, instr.Stype.signed_imm());
+				a.byte(0x89); a.byte(0xC6); // mov esi, eax
+				a.load(A::EDX, reg(instr.Stype.rs2));
+				a.mov_imm(A::ECX, m_pc);
+				a.call(function);
+				this->exit_if_faulted();
+			};
+
+			if (&decoded == &DECODED_INSTR(NOP)) {
+			}
+			else if (&decoded == &DECODED_INSTR(LI)) {
+				a.store_imm(reg(I.rd), I.signed_imm());
+			}
+			else if (&decoded == &DECODED_INSTR(ADDI))  op_imm(0);
+			else if (&decoded == &DECODED_INSTR(XORI))  op_imm(6);
+			else if (&decoded == &DECODED_INSTR(ORI))   op_imm(1);
+			else if (&decoded == &DECODED_INSTR(ANDI))  op_imm(4);
+			else if (&decoded == &DECODED_INSTR(SLTI))  set_imm(A::L);
+			else if (&decoded == &DECODED_INSTR(SLTIU)) set_imm(A::B);
+			else if (&decoded == &DECODED_INSTR(SLLI))  shift_imm(4);
+			else if (&decoded == &DECODED_INSTR(SRLI))  shift_imm(5);
+			else if (&decoded == &DECODED_INSTR(SRAI))  shift_imm(7);
+			else if (&decoded == &DECODED_INSTR(ADD))
+				op([&] { a.alu(0x01, A::EAX, A::ECX); });
+			else if (&decoded == &DECODED_INSTR(SUB))
+				op([&] { a.alu(0x29, A::EAX, A::ECX); });
+			else if (&decoded == &DECODED_INSTR(XOR))
+				op([&] { a.alu(0x31, A::EAX, A::ECX); });
+			else if (&decoded == &DECODED_INSTR(OR))
+				op([&] { a.alu(0x09, A::EAX, A::ECX); });
+			else if (&decoded == &DECODED_INSTR(AND))
+				op([&] { a.alu(0x21, A::EAX, A::ECX); });
+			else if (&decoded == &DECODED_INSTR(SLL))
+				op([&] { a.shift_cl(4, A::EAX); });
+			else if (&decoded == &DECODED_INSTR(SRL))
+				op([&] { a.shift_cl(5, A::EAX); });
+			else if (&decoded == &DECODED_INSTR(SLT))
+				op([&] { a.alu(0x39, A::EAX, A::ECX); a.set_eax(A::L); });
+			else if (&decoded == &DECODED_INSTR(SLTU))
+				op([&] { a.alu(0x39, A::EAX, A::ECX); a.set_eax(A::B); });
+			else if (&decoded == &DECODED_INSTR(MUL))
+				op([&] { a.imul(A::EAX, A::ECX); });
+			else if (&decoded == &DECODED_INSTR(LUI) && instr.Utype.rd != 0) {
+				a.store_imm(reg(instr.Utype.rd), instr.Utype.upper_imm());
+			}
+			else if (&decoded == &DECODED_INSTR(AUIPC) && instr.Utype.rd != 0) {
+				a.store_imm(reg(instr.Utype.rd), m_pc + instr.Utype.upper_imm());
+			}
+			else if (&decoded == &DECODED_INSTR(LB))  load((void*) &jit::load<uint8_t, int8_t>);
+			else if (&decoded == &DECODED_INSTR(LH))  load((void*) &jit::load<uint16_t, int16_t>);
+			else if (&decoded == &DECODED_INSTR(LW))  load((void*) &jit::load<uint32_t, uint32_t>);
+			else if (&decoded == &DECODED_INSTR(LBU)) load((void*) &jit::load<uint8_t, uint8_t>);
+			else if (&decoded == &DECODED_INSTR(LHU)) load((void*) &jit::load<uint16_t, uint16_t>);
+			else if (&decoded == &DECODED_INSTR(SB))  store((void*) &jit::store<uint8_t>);
+			else if (&decoded == &DECODED_INSTR(SH))  store((void*) &jit::store<uint16_t>);
+			else if (&decoded == &DECODED_INSTR(SW))  store((void*) &jit::store<uint32_t>);
+#ifdef RISCV_EXT_COMPRESSED
+			else if (&decoded == &DECODED_COMPR(C1_NOP_ADDI)) {
+				const auto ci = instr.compressed();
+				if (ci.CI.rd != 0) {
+					a.load(A::EAX, reg(ci.CI.rd));
+					a.alu_imm(0, A::EAX, ci.CI.signed_imm());
+					a.store(reg(ci.CI.rd), A::EAX);
+				}
+			}
+			else if (&decoded == &DECODED_COMPR(C1_LI)) {
+				const auto ci = instr.compressed();
+				if (ci.CI.rd != 0) a.store_imm(reg(ci.CI.rd), ci.CI.signed_imm());
+			}
+#endif
+			else {
+				// everything else is called exactly like the interpreter does
+				a.byte(0x48); a.byte(0xBE); a.qword((uintptr_t) decoded.handler); // mov rsi, imm64
+				a.mov_imm(A::EDX, instr.whole);
+				a.mov_imm(A::ECX, m_pc);
+				a.call((void*) &jit::handler);
+				this->exit_if_faulted();
+			}
+		}
+
+		bool Translator::branch(const rv32i_instruction instr,
+			const CPU<4>::instruction_t& decoded)
+		{
+			using A = Assembler;
+			auto& a = m_asm;
+			// misaligned jumps are left to the interpreter
+			constexpr uint32_t ALIGN_MASK = (compressed_enabled) ? 0x1 : 0x3;
+			if (!instr.is_long()) return false;
+
+			static const std::pair<const CPU<4>::instruction_t*, A::Cond> branches[] = {
+				{ &DECODED_INSTR(BEQ), A::E }, { &DECODED_INSTR(BNE), A::NE },
+				{ &DECODED_INSTR(BLT), A::L }, { &DECODED_INSTR(BGE), A::GE },
+				{ &DECODED_INSTR(BLTU), A::B }, { &DECODED_INSTR(BGEU), A::AE },
+			};
+			for (const auto& br : branches) {
+				if (&decoded != br.first) continue;
+				const uint32_t target = m_pc + instr.Btype.signed_imm();
+				if (target & ALIGN_MASK) return false;
+				a.load(A::EAX, reg(instr.Btype.rs1));
+				a.load(A::ECX, reg(instr.Btype.rs2));
+				a.alu(0x39, A::EAX, A::ECX);
+				const size_t taken = a.jcc(br.second);
+				this->finish(m_pc + 4);
+				a.bind(taken);
+				this->finish(target);
+				return true;
+			}
+			if (&decoded == &DECODED_INSTR(JAL)) {
+				const uint32_t target = m_pc + instr.Jtype.jump_offset();
+				if (target & ALIGN_MASK) return false;
+				if (instr.Jtype.rd != 0)
+					a.store_imm(reg(instr.Jtype.rd), m_pc + 4);
+				this->finish(target);
+				return true;
+			}
+			if (&decoded == &DECODED_INSTR(JALR)) {
+				a.load(A::EAX, reg(instr.Itype.rs1));
+				a.alu_imm(0, A::EAX, instr.Itype.signed_imm());
+				a.test_imm(A::EAX, ALIGN_MASK);
+				const size_t aligned = a.jcc(A::E);
+				this->exit_here();
+				a.bind(aligned);
+				if (instr.Itype.rd != 0)
+					a.store_imm(reg(instr.Itype.rd), m_pc + 4);
+				a.store(m_pc_disp, A::EAX);
+				a.mov_imm(A::EAX, m_count + 1);
+				m_exits.push_back(a.jmp());
+				return true;
+			}
+			return false;
+		}
+	} // jit
+
+	template <>
+	typename Jit<4>::native_t Jit<4>::translate(CPU<4>& cpu, address_t pc, Slot& slot)
+	{
+		// jump tracing lives in the interpreter
+		if (cpu.machine().verbose_jumps) return nullptr;
+		if (m_arena == nullptr) {
+			void* arena = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_EXEC,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (arena == MAP_FAILED) {
+				m_disabled = true;
+				return nullptr;
+			}
+			m_arena = (uint8_t*) arena;
+		}
+		static const size_t host_page = sysconf(_SC_PAGESIZE);
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			// the arena is never writable and executable at the same time,
+			// so the unused part of it is writable only while translating
+			const size_t unused = m_arena_used & ~(host_page - 1);
+			if (mprotect(m_arena + unused, ARENA_SIZE - unused, PROT_READ | PROT_WRITE) != 0) {
+				m_disabled = true;
+				return nullptr;
+			}
+			jit::Translator tr { cpu, m_arena + m_arena_used, ARENA_SIZE - m_arena_used };
+			bool translated = false;
+			try {
+				translated = tr.translate(pc, DecoderEntry<4>::BLOCK_MAX);
+			} catch (...) {
+				// out of memory, and the block stays with the interpreter
+			}
+			if (mprotect(m_arena + unused, ARENA_SIZE - unused, PROT_READ | PROT_EXEC) != 0) {
+				// the arena can not be used, and nothing in it can run
+				this->reset();
+				m_disabled = true;
+				return nullptr;
+			}
+			if (!tr.overflow()) {
+				if (!translated) return nullptr;
+				auto* native = (native_t) (m_arena + m_arena_used);
+				// keep the code 16-byte aligned
+				m_arena_used = (m_arena_used + tr.size() + 15) & ~(size_t) 15;
+				slot = { pc, slot.count, (uint8_t) tr.instructions(), tr.complete(), native };
+				return native;
+			}
+			// the arena is full, so start over
+			this->reset();
+		}
+		return nullptr;
+	}
+
+	template <>
+	void Jit<4>::reset() noexcept
+	{
+		if (m_slots != nullptr)
+			std::fill(m_slots.get(), m_slots.get() + SLOTS, Slot {});
+		m_arena_used = 0;
+	}
+
+	template <>
+	Jit<4>::~Jit()
+	{
+		if (m_arena != nullptr) munmap(m_arena, ARENA_SIZE);
+	}
+}
@@ -0,0 +1,401 @@
+#include "rv32i.hpp"
+#include "instr_helpers.hpp"
+#include <cstdarg>
+#include <dlfcn.h>
+
+namespace riscv
+{
+	// The generated C code keeps the guest registers in memory, and lets
+	// the host compiler allocate them within each block. Every instruction
+	// mirrors its interpreter handler, and anything that isn't translated
+	// inline (including every memory access) calls back into the emulator
+	// through the api below. The blocks follow the same rules as the JIT
+	// (see rv32i_jit.cpp) about where they stop and what they count.
+	namespace translation
+	{
+		using State = Translation<4>::State;
+		static constexpr int VERSION = 1;
+
+		template <typename T>
+		static uint32_t read(State* state, uint32_t addr, uint32_t pc) noexcept
+		{
+			auto& cpu = *state->cpu;
+			cpu.registers().pc = pc;
+			try {
+				return cpu.machine().memory.template read<T>(addr);
+			} catch (...) {
+				state->fail();
+				return 0;
+			}
+		}
+		template <typename T>
+		static void write(State* state, uint32_t addr, uint32_t value, uint32_t pc) noexcept
+		{
+			auto& cpu = *state->cpu;
+			cpu.registers().pc = pc;
+			try {
+				cpu.machine().memory.template write<T>(addr, value);
+			} catch (...) {
+				state->fail();
+			}
+		}
+		static void execute(State* state, uint32_t instr, uint32_t pc) noexcept
+		{
+			auto& cpu = *state->cpu;
+			cpu.registers().pc = pc;
+			try {
+				const rv32i_instruction instruction { instr };
+				cpu.decode(instruction).handler(cpu, instruction);
+			} catch (...) {
+				state->fail();
+			}
+		}
+
+		// must match struct riscv_api in the generated code
+		static const struct {
+			uint32_t (*read8) (State*, uint32_t, uint32_t);
+			uint32_t (*read16)(State*, uint32_t, uint32_t);
+			uint32_t (*read32)(State*, uint32_t, uint32_t);
+			void (*write8) (State*, uint32_t, uint32_t, uint32_t);
+			void (*write16)(State*, uint32_t, uint32_t, uint32_t);
+			void (*write32)(State*, uint32_t, uint32_t, uint32_t);
+			void (*execute)(State*, uint32_t, uint32_t);
+		} api {
+			&read<uint8_t>, &read<uint16_t>, &read<uint32_t>,
+			&write<uint8_t>, &write<uint16_t>, &write<uint32_t>,
+			&execute
+		};
+
+		static const char preamble[] = R"(#include <stdint.h>
+struct riscv_api {
+	uint32_t (*read8) (char*, uint32_t, uint32_t);
+	uint32_t (*read16)(char*, uint32_t, uint32_t);
+	uint32_t (*read32)(char*, uint32_t, uint32_t);
+	void (*write8) (char*, uint32_t, uint32_t, uint32_t);
+	void (*write16)(char*, uint32_t, uint32_t, uint32_t);
+	void (*write32)(char*, uint32_t, uint32_t, uint32_t);
+	void (*execute)(char*, uint32_t, uint32_t);
+};
+struct riscv_block {
+	uint32_t pc;
+	uint16_t instructions;
+	uint16_t complete;
+	uint32_t (*function)(uint32_t*, const struct riscv_api*, char*);
+};
+#define EXIT(pc, n) do { PC = (pc); return (n); } while (0)
+#define FAULTED (*s != 0)
+)";
+
+		static void emit(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+		static void emit(std::string& out, const char* fmt, ...)
+		{
+			char buffer[256];
+			va_list args;
+			va_start(args, fmt);
+			const int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+			va_end(args);
+			out.append(buffer, std::min((size_t) len, sizeof(buffer)-1));
+		}
+
+		class Generator
+		{
+		public:
+			Generator(const CPU<4>& cpu, std::string& out) : m_cpu(cpu), m_out(out) {}
+
+			// returns the number of instructions in the block at @pc,
+			// and whether it ends with a translated branch
+			unsigned block(uint32_t pc, bool& complete);
+
+		private:
+			void instruction(rv32i_instruction, const CPU<4>::instruction_t&);
+			bool branch(rv32i_instruction, const CPU<4>::instruction_t&);
+			void exit_if_faulted() {
+				emit(m_out, "\tif (FAULTED) EXIT(0x%Xu, %u);\n", m_pc, m_count);
+			}
+
+			const CPU<4>& m_cpu;
+			std::string&  m_out;
+			uint32_t m_pc = 0;
+			unsigned m_count = 0;
+		};
+
+		unsigned Generator::block(const uint32_t pc, bool& complete)
+		{
+			const auto& exec = m_cpu.machine().memory.exec_segment();
+			emit(m_out, "static uint32_t block_%X(uint32_t* r, const struct riscv_api* api, char* s)\n{\n"
+				"\tuint32_t v; (void) v;\n", pc);
+			m_pc = pc;
+			m_count = 0;
+			complete = false;
+			while (m_count < DecoderEntry<4>::BLOCK_MAX && exec.contains(m_pc))
+			{
+				const rv32i_instruction instr { exec.template read<uint32_t>(m_pc) };
+				const auto& decoded = m_cpu.decode(instr);
+				if (RV32I::is_block_end(instr)) {
+					complete = this->branch(instr, decoded);
+					if (complete) m_count++;
+					break;
+				}
+				this->instruction(instr, decoded);
+				m_count++;
+				m_pc += (compressed_enabled) ? instr.length() : 4;
+			}
+			if (!complete) emit(m_out, "\tEXIT(0x%Xu, %u);\n", m_pc, m_count);
+			m_out += "}\n";
+			return m_count;
+		}
+
+		void Generator::instruction(const rv32i_instruction instr,
+			const CPU<4>::instruction_t& decoded)
+		{
+			auto& o = m_out;
+			const auto& I = instr.Itype;
+			const auto& R = instr.Rtype;
+			const uint32_t imm = I.signed_imm();
+			const auto op_imm = [&] (const char* op) {
+				emit(o, "\tr[%u] = r[%u] %s 0x%Xu;\n", I.rd, I.rs1, op, imm);
+			};
+			const auto shift_imm = [&] (const char* op) {
+				emit(o, "\tr[%u] = r[%u] %s %u;\n", I.rd, I.rs1, op, I.shift_imm());
+			};
+			const auto op = [&] (const char* op) {
+				emit(o, "\tr[%u] = r[%u] %s r[%u];\n", R.rd, R.rs1, op, R.rs2);
+			};
+			const auto load = [&] (unsigned bits, const char* cast) {
+				emit(o, "\tv = api->read%u(s, r[%u] + 0x%Xu, 0x%Xu);\n", bits, I.rs1, imm, m_pc);
+				this->exit_if_faulted();
+				emit(o, "\tr[%u] = (uint32_t) (%s) v;\n", I.rd, cast);
+			};
+			const auto store = [&] (unsigned bits) {
+				emit(o, "\tapi->write%u(s, r[%u] + 0x%Xu, r[%u], 0x%Xu);\n", bits,
+					instr.Stype.rs1, (uint32_t) instr.Stype.signed_imm(), instr.Stype.rs2, m_pc);
+				this->exit_if_faulted();
+			};
+			// division by zero and overflow leave rd unchanged
+			const auto divide = [&] (bool is_signed, const char* op) {
+				if (is_signed) {
+					emit(o, "\tif (r[%u] != 0 && !(r[%u] == 0x80000000u && r[%u] == 0xFFFFFFFFu))"
+						" r[%u] = (uint32_t) ((int32_t) r[%u] %s (int32_t) r[%u]);\n",
+						R.rs2, R.rs1, R.rs2, R.rd, R.rs1, op, R.rs2);
+				} else {
+					emit(o, "\tif (r[%u] != 0) r[%u] = r[%u] %s r[%u];\n",
+						R.rs2, R.rd, R.rs1, op, R.rs2);
+				}
+			};
+
+			if (&decoded == &DECODED_INSTR(NOP)) {
+			}
+			else if (&decoded == &DECODED_INSTR(LI)) {
+				emit(o, "\tr[%u] = 0x%Xu;\n", I.rd, imm);
+			}
+			else if (&decoded == &DECODED_INSTR(ADDI))  op_imm("+");
+			else if (&decoded == &DECODED_INSTR(XORI))  op_imm("^");
+			else if (&decoded == &DECODED_INSTR(ORI))   op_imm("|");
+			else if (&decoded == &DECODED_INSTR(ANDI))  op_imm("&");
+			else if (&decoded == &DECODED_INSTR(SLTIU)) op_imm("<");
+			else if (&decoded == &DECODED_INSTR(SLTI)) {
+				emit(o, "\tr[%u] = (int32_t) r[%u] < %d;\n", I.rd, I.rs1, (int32_t) imm);
+			}
+			else if (&decoded == &DECODED_INSTR(SLLI))  shift_imm("<<");
+			else if (&decoded == &DECODED_INSTR(SRLI))  shift_imm(">>");
+			else if (&decoded == &DECODED_INSTR(SRAI)) {
+				emit(o, "\tr[%u] = (uint32_t) ((int32_t) r[%u] >> %u);\n", I.rd, I.rs1, I.shift_imm());
+			}
+			else if (&decoded == &DECODED_INSTR(ADD))  op("+");
+			else if (&decoded == &DECODED_INSTR(SUB))  op("-");
+			else if (&decoded == &DECODED_INSTR(XOR))  op("^");
+			else if (&decoded == &DECODED_INSTR(OR))   op("|");
+			else if (&decoded == &DECODED_INSTR(AND))  op("&");
+			else if (&decoded == &DECODED_INSTR(SLTU)) op("<");
+			else if (&decoded == &DECODED_INSTR(MUL))  op("*");
+			else if (&decoded == &DECODED_INSTR(SLT)) {
+				emit(o, "\tr[%u] = (int32_t) r[%u] < (int32_t) r[%u];\n", R.rd, R.rs1, R.rs2);
+			}
+			else if (&decoded == &DECODED_INSTR(SLL)) {
+				emit(o, "\tr[%u] = r[%u] << (r[%u] & 0x1F);\n", R.rd, R.rs1, R.rs2);
+			}
+			else if (&decoded == &DECODED_INSTR(SRL)) {
+				emit(o, "\tr[%u] = r[%u] >> (r[%u] & 0x1F);\n", R.rd, R.rs1, R.rs2);
+			}
+			else if (&decoded == &DECODED_INSTR(MULHU)) {
+				emit(o, "\tr[%u] = ((uint64_t) r[%u] * r[%u]) >> 32;\n", R.rd, R.rs1, R.rs2);
+			}
+			else if (&decoded == &DECODED_INSTR(DIV))  divide(true, "/");
+			else if (&decoded == &DECODED_INSTR(REM))  divide(true, "%");
+			else if (&decoded == &DECODED_INSTR(DIVU)) divide(false, "/");
+			else if (&decoded == &DECODED_INSTR(REMU)) divide(false, "%");
+			else if (&decoded == &DECODED_INSTR(LUI) && instr.Utype.rd != 0) {
+				emit(o, "\tr[%u] = 0x%Xu;\n", instr.Utype.rd, instr.Utype.upper_imm());
+			}
+			else if (&decoded == &DECODED_INSTR(AUIPC) && instr.Utype.rd != 0) {
+				emit(o, "\tr[%u] = 0x%Xu;\n", instr.Utype.rd, m_pc + instr.Utype.upper_imm());
+			}
+			else if (&decoded == &DECODED_INSTR(LB))  load(8,  "int8_t");
+			else if (&decoded == &DECODED_INSTR(LH))  load(16, "int16_t");
+			else if (&decoded == &DECODED_INSTR(LW))  load(32, "uint32_t");
+			else if (&decoded == &DECODED_INSTR(LBU)) load(8,  "uint8_t");
+			else if (&decoded == &DECODED_INSTR(LHU)) load(16, "uint16_t");
+			else if (&decoded == &DECODED_INSTR(SB))  store(8);
+			else if (&decoded == &DECODED_INSTR(SH))  store(16);
+			else if (&decoded == &DECODED_INSTR(SW))  store(32);
+#ifdef RISCV_EXT_COMPRESSED
+			else if (&decoded == &DECODED_COMPR(C1_NOP_ADDI)) {
+				const auto ci = instr.compressed();
+				if (ci.CI.rd != 0)
+					emit(o, "\tr[%u] += 0x%Xu;\n", ci.CI.rd, (uint32_t) ci.CI.signed_imm());
+			}
+			else if (&decoded == &DECODED_COMPR(C1_LI)) {
+				const auto ci = instr.compressed();
+				if (ci.CI.rd != 0)
+					emit(o, "\tr[%u] = 0x%Xu;\n", ci.CI.rd, (uint32_t) ci.CI.signed_imm());
+			}
+#endif
+			else {
+				// everything else is decoded and executed by the emulator
+				emit(o, "\tapi->execute(s, 0x%Xu, 0x%Xu);\n", instr.whole, m_pc);
+				this->exit_if_faulted();
+			}
+		}
+
+		bool Generator::branch(const rv32i_instruction instr,
+			const CPU<4>::instruction_t& decoded)
+		{
+			auto& o = m_out;
+			// misaligned jumps are left to the interpreter
+			constexpr uint32_t ALIGN_MASK = (compressed_enabled) ? 0x1 : 0x3;
+			if (!instr.is_long()) return false;
+
+			static const std::pair<const CPU<4>::instruction_t*, const char*> branches[] = {
+				{ &DECODED_INSTR(BEQ), "r[%u] == r[%u]" },
+				{ &DECODED_INSTR(BNE), "r[%u] != r[%u]" },
+				{ &DECODED_INSTR(BLT), "(int32_t) r[%u] < (int32_t) r[%u]" },
+				{ &DECODED_INSTR(BGE), "(int32_t) r[%u] >= (int32_t) r[%u]" },
+				{ &DECODED_INSTR(BLTU), "r[%u] < r[%u]" },
+				{ &DECODED_INSTR(BGEU), "r[%u] >= r[%u]" },
+			};
+			for (const auto& br : branches) {
+				if (&decoded != br.first) continue;
+				const uint32_t target = m_pc + instr.Btype.signed_imm();
+				if (target & ALIGN_MASK) return false;
+				o += "\tif (";
+				emit(o, br.second, instr.Btype.rs1, instr.Btype.rs2);
+				emit(o, ") EXIT(0x%Xu, %u);\n", target, m_count + 1);
+				emit(o, "\tEXIT(0x%Xu, %u);\n", m_pc + 4, m_count + 1);
+				return true;
+			}
+			if (&decoded == &DECODED_INSTR(JAL)) {
+				const uint32_t target = m_pc + instr.Jtype.jump_offset();
+				if (target & ALIGN_MASK) return false;
+				if (instr.Jtype.rd != 0)
+					emit(o, "\tr[%u] = 0x%Xu;\n", instr.Jtype.rd, m_pc + 4);
+				emit(o, "\tEXIT(0x%Xu, %u);\n", target, m_count + 1);
+				return true;
+			}
+			if (&decoded == &DECODED_INSTR(JALR)) {
+				emit(o, "\tv = r[%u] + 0x%Xu;\n", instr.Itype.rs1, (uint32_t) instr.Itype.signed_imm());
+				emit(o, "\tif (v & %u) EXIT(0x%Xu, %u);\n", ALIGN_MASK, m_pc, m_count);
+				if (instr.Itype.rd != 0)
+					emit(o, "\tr[%u] = 0x%Xu;\n", instr.Itype.rd, m_pc + 4);
+				emit(o, "\tEXIT(v, %u);\n", m_count + 1);
+				return true;
+			}
+			return false;
+		}
+	} // translation
+
+	template <>
+	std::string Translation<4>::generate(const Machine<4>& machine)
+	{
+		const auto& exec = machine.memory.exec_segment();
+		if (exec.fetch_size == 0) {
+			throw MachineException(ILLEGAL_OPERATION,
+				"Translation requires a read-only execute segment");
+		}
+		// blocks start after every block end, and at every static jump
+		// target, so that most PCs seen at runtime have a block
+		const auto index = [&] (address_t pc) { return (pc - exec.begin) / DIVISOR; };
+		std::vector<bool> starts(exec.size / DIVISOR), leaders(exec.size / DIVISOR);
+		constexpr uint32_t ALIGN_MASK = (compressed_enabled) ? 0x1 : 0x3;
+		bool leader = true;
+		for (address_t pc = exec.begin; exec.contains(pc); )
+		{
+			const rv32i_instruction instr { exec.template read<uint32_t>(pc) };
+			starts[index(pc)] = true;
+			if (leader) leaders[index(pc)] = true;
+			leader = RV32I::is_block_end(instr);
+			if (leader && instr.is_long()) {
+				address_t target = 0;
+				if (instr.opcode() == 0b1100011) target = pc + instr.Btype.signed_imm();
+				if (instr.opcode() == 0b1101111) target = pc + instr.Jtype.jump_offset();
+				if (exec.contains(target) && (target & ALIGN_MASK) == 0)
+					leaders[index(target)] = true;
+			}
+			pc += (compressed_enabled) ? instr.length() : 4;
+		}
+		if (exec.contains(machine.memory.start_address()))
+			leaders[index(machine.memory.start_address())] = true;
+
+		const int32_t pc_disp = (intptr_t) &machine.cpu.registers().pc
+			- (intptr_t) &machine.cpu.reg(0);
+		std::string out = translation::preamble;
+		translation::emit(out, "#define PC (*(uint32_t*) ((char*) r + (%d)))\n\n", pc_disp);
+
+		std::string table;
+		size_t blocks = 0;
+		translation::Generator generator { machine.cpu, out };
+		for (size_t i = 0; i < starts.size(); i++)
+		{
+			if (!starts[i] || !leaders[i]) continue;
+			const address_t pc = exec.begin + i * DIVISOR;
+			bool complete;
+			const unsigned instructions = generator.block(pc, complete);
+			if (instructions == 0) {
+				// eg. a system call, which is left to the interpreter
+				continue;
+			}
+			translation::emit(table, "\t{ 0x%X, %u, %u, block_%X },\n",
+				pc, instructions, complete, pc);
+			blocks++;
+		}
+		translation::emit(out, "\nconst int riscv_translation_version = %d;\n", translation::VERSION);
+		translation::emit(out, "const int riscv_translation_pc_disp = %d;\n", pc_disp);
+		translation::emit(out, "const uint64_t riscv_translation_hash = 0x%llXull;\n",
+			(unsigned long long) hash(machine.memory.binary()));
+		translation::emit(out, "const uint32_t riscv_translation_count = %zu;\n", blocks);
+		out += "const struct riscv_block riscv_translation_blocks[] = {\n" + table + "};\n";
+		return out;
+	}
+
+	template <>
+	bool Translation<4>::load(const Memory<4>& memory, const std::string& filename)
+	{
+		void* handle = dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+		if (handle == nullptr) return false;
+		std::shared_ptr<void> library { handle, dlclose };
+
+		const auto symbol = [handle] (const char* name) { return dlsym(handle, name); };
+		const auto* version = (const int*) symbol("riscv_translation_version");
+		const auto* pc_disp = (const int*) symbol("riscv_translation_pc_disp");
+		const auto* hash    = (const uint64_t*) symbol("riscv_translation_hash");
+		const auto* count   = (const uint32_t*) symbol("riscv_translation_count");
+		const auto* blocks  = (const Block*) symbol("riscv_translation_blocks");
+		if (!version || !pc_disp || !hash || !count || !blocks) return false;
+
+		const auto& exec = memory.exec_segment();
+		Registers<4> regs {};
+		if (*version != translation::VERSION
+			|| *pc_disp != (intptr_t) &regs.pc - (intptr_t) &regs.get(0)
+			|| *hash != Translation::hash(memory.binary())
+			|| exec.fetch_size == 0) return false;
+
+		m_blocks.assign(exec.size / DIVISOR, nullptr);
+		for (const Block* block = blocks; block < blocks + *count; block++) {
+			if (block->pc - exec.begin < exec.size)
+				m_blocks[(block->pc - exec.begin) / DIVISOR] = block;
+		}
+		m_begin   = exec.begin;
+		m_api     = &translation::api;
+		m_library = std::move(library);
+		return true;
+	}
+}
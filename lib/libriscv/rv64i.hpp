@@ -20,7 +20,8 @@ namespace riscv
 		static inline uint64_t SRA(bool is_signed, uint64_t shifts, uint64_t value)
 		{
 			const uint64_t sign_bits = -is_signed ^ 0x0;
-			const uint64_t sign_shifted = sign_bits << (64 - shifts);
+			// nothing is shifted in when nothing is shifted
+			const uint64_t sign_shifted = (shifts != 0) ? sign_bits << (64 - shifts) : 0;
 			return (value >> shifts) | sign_shifted;
 		}
 	};
@@ -11,7 +11,7 @@ namespace riscv
 		uint16_t reg_size;
 		uint16_t page_size;
 		uint16_t attr_size;
-		uint16_t reserved;
+		uint16_t page_shift; // zero before pages could be larger than 4k
 		uint16_t cpu_offset;
 		uint16_t mem_offset;
 
@@ -30,9 +30,9 @@ namespace riscv
 			.magic    = MAGiC_V4LUE,
 			.n_pages  = (unsigned) memory.nonshared_pages_active(),
 			.reg_size = sizeof(Registers<W>),
-			.page_size = Page::size(),
+			.page_size = (uint16_t) Page::size(),
 			.attr_size = sizeof(PageAttributes),
-			.reserved = 0,
+			.page_shift = Page::SHIFT,
 			.cpu_offset = sizeof(SerializedMachine<W>),
 			.mem_offset = sizeof(SerializedMachine<W>) + sizeof(Registers<W>),
 		};
@@ -54,14 +54,14 @@ namespace riscv
 			this->m_pages.size() * (sizeof(SerializedPage) + Page::size());
 		vec.reserve(vec.size() + est_page_bytes);
 
-		for (const auto& it : this->m_pages)
+		this->m_pages.for_each([&vec] (address_t pageno, const Page* page_ptr)
 		{
-			const auto& page = *it.second;
+			const auto& page = *page_ptr;
 			assert(page.attr.is_cow == false);
 			// we want to ignore shared pages
-			if (page.attr.shared) continue;
+			if (page.attr.shared) return;
 			const SerializedPage spage {
-				.addr = it.first,
+				.addr = pageno,
 				.attr = page.attr
 			};
 			auto* sptr = (const uint8_t*) &spage;
@@ -69,7 +69,7 @@ namespace riscv
 			// page data
 			auto* pptr = page.data();
 			vec.insert(vec.end(), pptr, pptr + Page::size());
-		}
+		});
 	}
 
 	template <int W>
@@ -83,7 +83,9 @@ namespace riscv
 			return -1;
 		if (header.reg_size != sizeof(Registers<W>))
 			return -2;
-		if (header.page_size != Page::size())
+		// page_size can not hold 64k, so check the shift as well
+		if (header.page_size != (uint16_t) Page::size()
+			|| (header.page_shift != 0 ? header.page_shift : 12) != Page::SHIFT)
 			return -3;
 		if (header.attr_size != sizeof(PageAttributes))
 			return -4;
@@ -97,17 +99,16 @@ namespace riscv
 	{
 		assert(vec.size() >= state.cpu_offset + sizeof(Registers<W>));
 		// restore CPU registers and counters
-		this->m_regs = *(const Registers<W>*) &vec[state.cpu_offset];
+		this->restore_registers(*(const Registers<W>*) &vec[state.cpu_offset]);
+	}
+	template <int W>
+	void CPU<W>::restore_registers(const Registers<W>& regs)
+	{
+		this->m_regs = regs;
 #ifdef RISCV_EXT_ATOMICS
 		this->m_atomics = {};
 #endif
-		// reset the instruction page pointer
-		this->m_current_page = {};
-#ifdef RISCV_PAGE_CACHE
-		// reset the page cache
-		this->m_page_cache = {};
-		this->m_cache_iterator = 0;
-#endif
+		this->reset_page_cache();
 	}
 	template <int W>
 	void Memory<W>::deserialize_from(const std::vector<uint8_t>& vec,
@@ -126,11 +127,104 @@ namespace riscv
 			const auto& page = *(SerializedPage*) &vec[off];
 			off += sizeof(SerializedPage);
 			const auto& data = *(PageData*) &vec[off];
-			m_pages.insert({page.addr, new Page{page.attr, data}});
+			auto* newpage = this->new_page(page.addr);
+			newpage->attr = page.attr;
+			newpage->attr.shared = false; // the copy is ours
+			newpage->page() = data;
+			m_pages.insert(page.addr, newpage);
+			this->flat_protect(page.addr);
 			off += Page::size();
 		}
 	}
 
+	template <int W>
+	void Machine<W>::checkpoint()
+	{
+		this->m_checkpoint = std::make_shared<const Registers<W>> (cpu.registers());
+		memory.checkpoint();
+	}
+	template <int W>
+	void Machine<W>::restore_checkpoint()
+	{
+		if (m_checkpoint == nullptr || !memory.has_checkpoint()) {
+			throw MachineException(ILLEGAL_OPERATION, "There is no checkpoint to restore");
+		}
+		cpu.restore_registers(*m_checkpoint);
+		memory.restore_checkpoint();
+	}
+
+	template <int W>
+	void Memory<W>::checkpoint()
+	{
+		this->discard_checkpoint();
+		this->m_dirty.reset(new PageTable<W>);
+		// writes must reach create_page() again, to keep the originals
+		this->tlb_flush();
+		m_pages.for_each([this] (address_t pageno, Page*) {
+			this->flat_protect(pageno);
+		});
+	}
+	template <int W>
+	void Memory<W>::mark_dirty(address_t pageno)
+	{
+		if (m_dirty->find(pageno) != nullptr) return;
+		const Page* page = m_pages.find(pageno);
+		Page* original = const_cast<Page*> (&Page::cow_page());
+		if (page != nullptr) {
+			// shared pages are not ours to change, so only their place is kept
+			original = (page->attr.shared) ? const_cast<Page*> (page)
+				: new Page{page->attr, page->page()};
+		}
+		m_dirty->insert(pageno, original);
+	}
+	template <int W>
+	void Memory<W>::restore_checkpoint()
+	{
+		if (m_dirty == nullptr) {
+			throw MachineException(ILLEGAL_OPERATION, "There is no checkpoint to restore");
+		}
+		// stop keeping originals while putting them back
+		auto dirty = std::move(this->m_dirty);
+		std::vector<address_t> protect;
+		dirty->for_each([this, &protect] (address_t pageno, Page* original) {
+			if constexpr (flat_memory_enabled) protect.push_back(pageno);
+			Page* page = m_pages.find(pageno);
+			if (original->attr.is_cow || original->attr.shared) {
+				if (page != original) {
+					this->free_pages((address_t) pageno << Page::SHIFT, Page::size());
+					if (original->attr.shared)
+						m_pages.insert(pageno, original);
+				}
+				return;
+			}
+			if (page == nullptr || page->attr.shared) {
+				// it was freed, or replaced by a shared page
+				m_pages.erase(pageno);
+				page = m_pages.insert(pageno, this->new_page(pageno));
+			}
+			page->attr = original->attr;
+			page->page() = original->page();
+			page->invalidate_decoder_cache(Page::size());
+			delete original;
+		});
+		this->m_dirty = std::move(dirty);
+		this->m_dirty->clear();
+		this->tlb_flush();
+		for (const auto pageno : protect) {
+			this->flat_protect(pageno);
+		}
+	}
+	template <int W>
+	void Memory<W>::discard_checkpoint() noexcept
+	{
+		if (m_dirty == nullptr) return;
+		m_dirty->for_each([] (address_t, Page* original) {
+			if (!original->attr.is_cow && !original->attr.shared)
+				delete original;
+		});
+		this->m_dirty.reset();
+	}
+
 	template struct Machine<4>;
 	template struct CPU<4>;
 	template struct Memory<4>;
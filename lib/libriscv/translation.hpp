@@ -0,0 +1,77 @@
+#pragma once
+#include "binary_view.hpp"
+#include "common.hpp"
+#include "types.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace riscv
+{
+	template<int W> struct Machine;
+	template<int W> struct Memory;
+
+	// Ahead-of-time translation: rvtranslate turns every block in the
+	// execute segment of a program into a C function, and builds them
+	// into a shared object. When the shared object was made from the
+	// same program, its blocks replace the interpreter for those PCs.
+	// Like the JIT, translated blocks stop before anything that needs
+	// the interpreter, so the instruction counter stays exact.
+	template <int W>
+	struct Translation
+	{
+		using address_t = address_type<W>;
+
+		// shared between translated code and the functions it calls
+		struct State {
+			bool faulted = false; // must be first, tested by translated code
+			CPU<W>* cpu = nullptr;
+			std::exception_ptr exception = nullptr;
+
+			void fail() noexcept {
+				this->faulted = true;
+				this->exception = std::current_exception();
+			}
+		};
+		// one translated block, as laid out in the shared object
+		struct Block {
+			uint32_t pc;
+			uint16_t instructions;
+			uint16_t complete; // the block ended with a translated branch
+			uint32_t (*function)(void* regs, const void* api, State*);
+		};
+
+		// C source for every block in the execute segment of @machine
+		static std::string generate(const Machine<W>& machine);
+		// identifies the program a shared object was translated from
+		static uint64_t hash(const BinaryView& binary) noexcept {
+			uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+			for (const uint8_t byte : binary) {
+				hash = (hash ^ byte) * 0x100000001b3ull;
+			}
+			return hash;
+		}
+
+		// returns false unless @filename was translated from the
+		// program in @memory, in which case its blocks are used
+		bool load(const Memory<W>& memory, const std::string& filename);
+
+		// runs the translated block at PC, if there is one, and
+		// returns true when the whole block has been executed
+		inline bool simulate(CPU<W>&, uint64_t max_counter);
+
+	private:
+		static constexpr size_t DIVISOR = (compressed_enabled) ? 2 : 4;
+
+		std::shared_ptr<void> m_library = nullptr;
+		// by offset into the execute segment
+		std::vector<const Block*> m_blocks;
+		address_t   m_begin = 0;
+		const void* m_api = nullptr;
+		State       m_state;
+	};
+
+	// only RV32 is translated (see rv32i_translation.cpp)
+	template <> std::string Translation<4>::generate(const Machine<4>&);
+	template <> bool Translation<4>::load(const Memory<4>&, const std::string&);
+}
@@ -14,7 +14,7 @@ void test_custom_machine()
 	const uint32_t entry_point = 0x1068;
 	m2.cpu.jump(entry_point);
 
-	assert(m2.cpu.registers().counter == 0);
+	assert(m2.cpu.instruction_counter() == 0);
 	assert(m2.cpu.registers().pc == entry_point);
 	assert(m2.free_memory() == 65536);
 }
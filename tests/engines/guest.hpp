@@ -0,0 +1,125 @@
+#pragma once
+#include <libriscv/machine.hpp>
+#include <libriscv/util/elf.h>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+// Just enough of an RV32I assembler to write the guest programs
+// of the engine tests, which run them as ELF programs, so that
+// they are executed from the execute segment.
+struct Assembler
+{
+	static constexpr uint32_t BASE = 0x10000;
+
+	uint32_t pc() const noexcept { return BASE + code.size(); }
+	void emit(uint32_t instr) {
+		for (int i = 0; i < 4; i++) code.push_back(instr >> (8 * i));
+	}
+
+	static uint32_t rtype(uint32_t op, int rd, int f3, int rs1, int rs2, int f7) {
+		return op | (rd << 7) | (f3 << 12) | (rs1 << 15) | (rs2 << 20) | (f7 << 25);
+	}
+	static uint32_t itype(uint32_t op, int rd, int f3, int rs1, int32_t imm) {
+		return op | (rd << 7) | (f3 << 12) | (rs1 << 15) | ((imm & 0xFFF) << 20);
+	}
+	static uint32_t stype(int f3, int rs1, int rs2, int32_t imm) {
+		return 0x23 | ((imm & 0x1F) << 7) | (f3 << 12) | (rs1 << 15)
+			| (rs2 << 20) | (((imm >> 5) & 0x7F) << 25);
+	}
+	static uint32_t btype(int f3, int rs1, int rs2, int32_t offset) {
+		const uint32_t imm = offset & 0x1FFF;
+		return 0x63 | (((imm >> 11) & 1) << 7) | (((imm >> 1) & 0xF) << 8)
+			| (f3 << 12) | (rs1 << 15) | (rs2 << 20)
+			| (((imm >> 5) & 0x3F) << 25) | ((imm >> 12) << 31);
+	}
+	static uint32_t jtype(int rd, int32_t offset) {
+		const uint32_t imm = offset & 0x1FFFFF;
+		return 0x6F | (rd << 7) | (((imm >> 12) & 0xFF) << 12)
+			| (((imm >> 11) & 1) << 20) | (((imm >> 1) & 0x3FF) << 21)
+			| ((imm >> 20) << 31);
+	}
+
+	void lui(int rd, uint32_t imm)   { emit(0x37 | (rd << 7) | (imm << 12)); }
+	void auipc(int rd, uint32_t imm) { emit(0x17 | (rd << 7) | (imm << 12)); }
+	void addi(int rd, int rs1, int32_t imm) { emit(itype(0x13, rd, 0, rs1, imm)); }
+	void srai(int rd, int rs1, int shamt) { emit(itype(0x13, rd, 5, rs1, 0x400 | shamt)); }
+	void add(int rd, int rs1, int rs2) { emit(rtype(0x33, rd, 0, rs1, rs2, 0)); }
+	void lw(int rd, int rs1, int32_t imm) { emit(itype(0x03, rd, 2, rs1, imm)); }
+	void sw(int rs2, int rs1, int32_t imm) { emit(stype(2, rs1, rs2, imm)); }
+	void jal(int rd, uint32_t target) { emit(jtype(rd, target - pc())); }
+	void jalr(int rd, int rs1, int32_t imm) { emit(itype(0x67, rd, 0, rs1, imm)); }
+	void beq(int rs1, int rs2, uint32_t target) { emit(btype(0, rs1, rs2, target - pc())); }
+	void bne(int rs1, int rs2, uint32_t target) { emit(btype(1, rs1, rs2, target - pc())); }
+	void blt(int rs1, int rs2, uint32_t target) { emit(btype(4, rs1, rs2, target - pc())); }
+	void fence_i() { emit(0x100F); }
+	// loads a 32-bit constant with LUI + ADDI, which are fused
+	void li(int rd, uint32_t value) {
+		lui(rd, (value + 0x800) >> 12);
+		addi(rd, rd, value & 0xFFF);
+	}
+	// the exit system call, which the tests install
+	void exit() {
+		addi(17, 0, 93);
+		emit(0x73); // ECALL
+	}
+
+	std::vector<uint8_t> code;
+};
+
+// An ELF program with the code as its only (read+execute) segment
+inline std::vector<uint8_t> build_elf(const Assembler& a)
+{
+	static constexpr size_t OFFSET = 0x100;
+	std::vector<uint8_t> binary(OFFSET + a.code.size());
+	auto* hdr = (Elf32_Ehdr*) binary.data();
+	std::memcpy(hdr->e_ident, ELFMAG, 4);
+	hdr->e_ident[EI_CLASS] = ELFCLASS32;
+	hdr->e_ident[EI_DATA] = ELFDATA2LSB;
+	hdr->e_ident[EI_VERSION] = EV_CURRENT;
+	hdr->e_type = ET_EXEC;
+	hdr->e_machine = EM_RISCV;
+	hdr->e_version = EV_CURRENT;
+	hdr->e_entry = Assembler::BASE;
+	hdr->e_ehsize = sizeof(Elf32_Ehdr);
+	hdr->e_phoff = sizeof(Elf32_Ehdr);
+	hdr->e_phentsize = sizeof(Elf32_Phdr);
+	hdr->e_phnum = 1;
+	// a single zeroed section header
+	hdr->e_shoff = hdr->e_phoff + sizeof(Elf32_Phdr);
+	hdr->e_shentsize = sizeof(Elf32_Shdr);
+
+	auto* phdr = (Elf32_Phdr*) &binary[hdr->e_phoff];
+	phdr->p_type = PT_LOAD;
+	phdr->p_offset = OFFSET;
+	phdr->p_vaddr = phdr->p_paddr = Assembler::BASE;
+	phdr->p_filesz = phdr->p_memsz = a.code.size();
+	phdr->p_flags = PF_R | PF_X;
+	phdr->p_align = riscv::Page::size();
+	std::memcpy(&binary[OFFSET], a.code.data(), a.code.size());
+	return binary;
+}
+
+template <int W>
+inline void install_exit(riscv::Machine<W>& machine)
+{
+	machine.install_syscall_handler(93,
+		[] (riscv::Machine<W>& machine) -> long {
+			machine.stop();
+			return 0;
+		});
+}
+
+// runs until the machine stops, and returns the type of the
+// exception that stopped it instead, if any
+template <int W>
+inline int run(riscv::Machine<W>& machine, uint64_t max_instructions = 100'000)
+{
+	try {
+		machine.simulate(max_instructions);
+	} catch (const riscv::MachineException& e) {
+		return e.type();
+	}
+	assert(machine.stopped());
+	return -1;
+}
@@ -0,0 +1,21 @@
+#include <cstdio>
+#include <libriscv/common.hpp>
+
+extern void test_flat_memory();
+extern void test_fetch();
+extern void test_blocks();
+extern void test_jit();
+extern void test_translation();
+
+int main()
+{
+	riscv::verbose_machine = false;
+
+	test_flat_memory();
+	test_fetch();
+	test_blocks();
+	test_jit();
+	test_translation();
+	printf("Tests passed!\n");
+	return 0;
+}
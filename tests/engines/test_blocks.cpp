@@ -0,0 +1,202 @@
+#include "guest.hpp"
+using namespace riscv;
+static constexpr uint64_t MEMORY = 4ull << 20;
+
+// instruction limits end in the middle of a block
+static void test_instruction_limit()
+{
+	Assembler a;
+	for (int i = 0; i < 20; i++) a.addi(5, 5, 1);
+	a.exit();
+	const auto binary = build_elf(a);
+	Machine<RISCV32> machine { binary, MEMORY };
+	install_exit(machine);
+
+	// the first time, before the block is decoded
+	machine.simulate(7);
+	assert(machine.cpu.instruction_counter() == 7);
+	assert(machine.cpu.pc() == Assembler::BASE + 7 * 4);
+	assert(machine.cpu.reg(5) == 7);
+	// then from the middle of the decoded block
+	machine.simulate(5);
+	assert(machine.cpu.instruction_counter() == 12);
+	assert(machine.cpu.reg(5) == 12);
+	assert(!machine.stopped());
+	// and the whole block again, from the start
+	machine.cpu.jump(Assembler::BASE);
+	machine.cpu.reg(5) = 0;
+	machine.cpu.reset_instruction_counter();
+	machine.simulate(19);
+	assert(machine.cpu.instruction_counter() == 19);
+	assert(machine.cpu.reg(5) == 19);
+	assert(run(machine) == -1);
+	assert(machine.cpu.instruction_counter() == 22);
+}
+
+// the faulting instruction is not counted, nor anything after it
+static void test_faulting_block()
+{
+	Assembler a;
+	a.li(10, Assembler::BASE);
+	a.addi(5, 0, 1);
+	a.addi(5, 5, 1);
+	const uint32_t store = a.pc();
+	a.sw(5, 10, 0); // the execute segment is read-only
+	a.addi(5, 5, 1);
+	a.exit();
+	// a fused AUIPC + LW, where the load faults
+	const uint32_t global = a.pc();
+	a.auipc(6, 0x10); // global + 0x10000
+	a.lw(6, 6, 0);
+	a.exit();
+	const auto binary = build_elf(a);
+	Machine<RISCV32> machine { binary, MEMORY };
+	install_exit(machine);
+	const uint32_t unreadable = global + 0x10000;
+	machine.memory.set_page_attr(unreadable & ~(Page::size()-1), Page::size(), {
+		.read = false, .write = false, .exec = false
+	});
+
+	for (int i = 0; i < 2; i++) {
+		machine.cpu.jump(Assembler::BASE);
+		machine.cpu.reset_instruction_counter();
+		assert(run(machine) == PROTECTION_FAULT);
+		assert(machine.cpu.pc() == store);
+		assert(machine.cpu.instruction_counter() == 4);
+		assert(machine.cpu.reg(5) == 2);
+	}
+	for (int i = 0; i < 2; i++) {
+		machine.cpu.jump(global);
+		machine.cpu.reset_instruction_counter();
+		assert(run(machine) == PROTECTION_FAULT);
+		assert(machine.cpu.pc() == global + 4);
+		assert(machine.cpu.instruction_counter() == 1);
+		assert(machine.cpu.reg(6) == unreadable);
+	}
+}
+
+// fused pairs keep the entry of their second instruction
+static void test_jump_into_fused_pair()
+{
+	Assembler a;
+	a.addi(6, 0, 3);
+	a.lui(5, 0x1);
+	const uint32_t loop = a.pc();
+	a.addi(5, 5, 1); // fused with the LUI, and a branch target
+	a.addi(6, 6, -1);
+	a.bne(6, 0, loop);
+	a.exit();
+	const auto binary = build_elf(a);
+	Machine<RISCV32> machine { binary, MEMORY };
+	install_exit(machine);
+
+	assert(run(machine) == -1);
+	assert(machine.cpu.reg(5) == 0x1003);
+	assert(machine.cpu.reg(6) == 0);
+	assert(machine.cpu.instruction_counter() == 2 + 3 * 3 + 2);
+	// straight into the second half of the pair
+	machine.cpu.jump(loop);
+	machine.cpu.reg(5) = 0x100;
+	machine.cpu.reg(6) = 1;
+	machine.cpu.reset_instruction_counter();
+	assert(run(machine) == -1);
+	assert(machine.cpu.reg(5) == 0x101);
+	assert(machine.cpu.instruction_counter() == 3 + 2);
+}
+
+// code that is written to and then fenced is decoded again
+static void test_self_modifying_code()
+{
+	// outside of the execute segment, in writable pages
+	static constexpr uint32_t CODE = 0x1000;
+	Assembler a;
+	a.addi(5, 5, 1); // patched below
+	a.jalr(0, 1, 0);
+	const uint32_t start = CODE + a.code.size();
+	a.jal(1, Assembler::BASE);
+	a.li(6, Assembler::itype(0x13, 5, 0, 5, 16)); // ADDI x5, x5, 16
+	a.li(7, CODE);
+	a.sw(6, 7, 0);
+	a.fence_i();
+	a.jal(1, Assembler::BASE);
+	a.exit();
+
+	Machine<RISCV32> machine { std::vector<uint8_t>{}, MEMORY };
+	install_exit(machine);
+	machine.memory.memcpy(CODE, a.code.data(), a.code.size());
+	machine.memory.set_page_attr(CODE, Page::size(), {
+		.read = true, .write = true, .exec = true
+	});
+	const uint32_t original = machine.memory.read<uint32_t> (CODE);
+
+	for (int i = 0; i < 2; i++) {
+		machine.memory.write<uint32_t> (CODE, original);
+		machine.cpu.jump(start);
+		machine.cpu.reg(5) = 0;
+		assert(run(machine) == -1);
+		assert(machine.cpu.reg(5) == 17);
+	}
+}
+
+// forked machines execute from shared pages, and each one
+// decodes and rewrites its own copy of them
+static void test_forked_code()
+{
+#ifdef RISCV_INSTR_CACHE
+	if constexpr (flat_memory_enabled) return;
+	static constexpr uint32_t CODE = 0x1000;
+	Assembler a;
+	a.addi(5, 5, 1); // patched by the child
+	a.jalr(0, 1, 0);
+	const uint32_t call = CODE + a.code.size();
+	a.jal(1, Assembler::BASE);
+	a.exit();
+	const uint32_t patch = CODE + a.code.size();
+	a.li(6, Assembler::itype(0x13, 5, 0, 5, 16)); // ADDI x5, x5, 16
+	a.li(7, CODE);
+	a.sw(6, 7, 0);
+	a.fence_i();
+	a.jal(1, Assembler::BASE);
+	a.exit();
+
+	Machine<RISCV32> parent { std::vector<uint8_t>{}, MEMORY };
+	install_exit(parent);
+	parent.memory.memcpy(CODE, a.code.data(), a.code.size());
+	parent.memory.set_page_attr(CODE, Page::size(), {
+		.read = true, .write = true, .exec = true
+	});
+	auto calls = [] (Machine<RISCV32>& machine, uint32_t entry) {
+		machine.cpu.jump(entry);
+		machine.cpu.reg(5) = 0;
+		assert(run(machine) == -1);
+		return machine.cpu.reg(5);
+	};
+	constexpr size_t cache_size = sizeof(DecoderCache<Page::SIZE>);
+	assert(calls(parent, call) == 1);
+	assert(parent.memory.decoder_cache_size() == cache_size);
+
+	// the decoder caches of pages that become shared are dropped
+	auto child = parent.fork();
+	assert(parent.memory.decoder_cache_size() == 0);
+	assert(child->memory.decoder_cache_size() == 0);
+	assert(calls(*child, patch) == 16);
+	assert(child->memory.decoder_cache_size() == cache_size);
+	assert(calls(*child, call) == 16);
+	// the parent decodes its own copy, without the patch
+	assert(calls(parent, call) == 1);
+	assert(parent.memory.decoder_cache_size() == cache_size);
+	assert(parent.memory.nonshared_pages_active() == 1);
+	assert(calls(*child, call) == 16);
+#endif
+}
+
+void test_blocks()
+{
+	if constexpr (counter_enabled) {
+		test_instruction_limit();
+		test_faulting_block();
+		test_jump_into_fused_pair();
+	}
+	test_self_modifying_code();
+	test_forked_code();
+}
@@ -0,0 +1,33 @@
+#include "guest.hpp"
+using namespace riscv;
+static constexpr uint64_t MEMORY = 4ull << 20;
+
+// instructions outside of the execute segment are read from pages,
+// and no page is current before the first of them, not even page 0
+void test_fetch()
+{
+	Assembler a;
+	a.addi(5, 0, 1);
+	a.exit();
+	const auto binary = build_elf(a);
+	Machine<RISCV32> machine { binary, MEMORY };
+	install_exit(machine);
+
+	// a call through a null function pointer
+	machine.cpu.jump(0);
+	assert(run(machine) == EXECUTION_SPACE_PROTECTION_FAULT);
+	machine.cpu.jump(Assembler::BASE);
+	assert(run(machine) == -1);
+	machine.cpu.reset_page_cache();
+	machine.cpu.jump(0);
+	assert(run(machine) == EXECUTION_SPACE_PROTECTION_FAULT);
+
+	// nor in a forked machine, which has pages of its own
+	if constexpr (!flat_memory_enabled) {
+		auto child = machine.fork();
+		child->cpu.jump(0);
+		assert(run(*child) == EXECUTION_SPACE_PROTECTION_FAULT);
+		child->cpu.jump(Assembler::BASE);
+		assert(run(*child) == -1);
+	}
+}
@@ -0,0 +1,51 @@
+#include "guest.hpp"
+#include <signal.h>
+using namespace riscv;
+static constexpr uint64_t MEMORY = 4ull << 20;
+
+static int host_faults = 0;
+static void host_handler(int, siginfo_t*, void*) {
+	host_faults++;
+}
+
+// Guest accesses never fault on the host, so the SIGSEGV handler of
+// the host stays in place, and guest faults are raised as before.
+void test_flat_memory()
+{
+#ifdef RISCV_FLAT_MEMORY
+	struct sigaction action {};
+	action.sa_sigaction = host_handler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, nullptr);
+
+	static constexpr uint32_t UNREADABLE = 0x80000;
+	Assembler a;
+	a.li(11, UNREADABLE);
+	const uint32_t load = a.pc();
+	a.lw(6, 11, 0);
+	a.exit();
+	const auto binary = build_elf(a);
+	Machine<RISCV32> machine { binary, MEMORY };
+	install_exit(machine);
+	machine.memory.set_page_attr(UNREADABLE, Page::size(), {
+		.read = false, .write = false, .exec = false
+	});
+
+	struct sigaction current {};
+	sigaction(SIGSEGV, nullptr, &current);
+	assert(current.sa_sigaction == host_handler);
+
+	for (int i = 1; i <= 2; i++) {
+		raise(SIGSEGV);
+		assert(host_faults == i);
+		machine.cpu.jump(Assembler::BASE);
+		assert(run(machine) == PROTECTION_FAULT);
+		assert(machine.cpu.pc() == load);
+	}
+
+	// the last bytes of the address space
+	machine.memory.write<uint16_t>(0xFFFFFFFE, 0x1234);
+	assert(machine.memory.read<uint16_t>(0xFFFFFFFE) == 0x1234);
+#endif
+}
@@ -0,0 +1,138 @@
+#include "guest.hpp"
+#include <array>
+using namespace riscv;
+static constexpr uint64_t MEMORY = 4ull << 20;
+static constexpr uint32_t UNREADABLE = 0x80000;
+
+// Each program is run many times on the same machine, so that with
+// RISCV_JIT the first runs are interpreted, and the later ones run
+// native code once its blocks are hot. Every run must end the same.
+static constexpr int RUNS = 200;
+#ifdef RISCV_JIT
+static_assert(RUNS > 2 * Jit<4>::HOT_BLOCK, "The blocks must become hot");
+#endif
+
+struct Outcome {
+	std::array<uint32_t, 32> regs;
+	uint32_t pc;
+	uint64_t counter;
+	int      fault;
+
+	bool operator== (const Outcome& other) const noexcept {
+		return regs == other.regs && pc == other.pc
+			&& counter == other.counter && fault == other.fault;
+	}
+};
+
+static Outcome differential(const Assembler& a)
+{
+	const auto binary = build_elf(a);
+	Machine<RISCV32> machine { binary, MEMORY };
+	install_exit(machine);
+	machine.memory.set_page_attr(UNREADABLE, Page::size(), {
+		.read = false, .write = false, .exec = false
+	});
+
+	Outcome first {};
+	for (int i = 0; i < RUNS; i++) {
+		for (int reg = 1; reg < 32; reg++)
+			machine.cpu.reg(reg) = 0x1000 * reg + 1;
+		machine.cpu.jump(Assembler::BASE);
+		machine.cpu.reset_instruction_counter();
+		Outcome outcome {};
+		outcome.fault = run(machine);
+		for (int reg = 0; reg < 32; reg++)
+			outcome.regs[reg] = machine.cpu.reg(reg);
+		outcome.pc = machine.cpu.pc();
+		outcome.counter = machine.cpu.instruction_counter();
+		if (i == 0) first = outcome;
+		assert(outcome == first);
+	}
+	return first;
+}
+
+static void test_branches()
+{
+	Assembler a;
+	a.addi(5, 0, 10);
+	a.addi(7, 0, 0);
+	const uint32_t loop = a.pc();
+	a.add(7, 7, 5);
+	a.addi(5, 5, -1);
+	a.blt(0, 5, loop);  // taken 9 times
+	a.bne(5, 0, loop);  // not taken
+	a.beq(5, 0, a.pc() + 8);
+	a.addi(7, 0, -1);   // skipped
+	a.li(8, 0x80000001);
+	a.srai(9, 8, 0);
+	a.srai(12, 8, 31);
+	a.srai(11, 8, 1);
+	a.exit();
+
+	const auto outcome = differential(a);
+	assert(outcome.fault == -1);
+	assert(outcome.regs[7] == 55);
+	assert(outcome.regs[9] == 0x80000001);
+	assert(outcome.regs[12] == 0xFFFFFFFF);
+	assert(outcome.regs[11] == 0xC0000000);
+}
+
+static void test_faulting_load()
+{
+	Assembler a;
+	a.li(10, Assembler::BASE);
+	a.lw(5, 10, 0);
+	a.addi(6, 5, 1);
+	a.li(11, UNREADABLE);
+	const uint32_t load = a.pc();
+	a.lw(12, 11, 4);
+	a.addi(6, 6, 1);
+	a.exit();
+
+	const auto outcome = differential(a);
+	assert(outcome.fault == PROTECTION_FAULT);
+	assert(outcome.pc == load);
+	assert(outcome.regs[12] == 0xC001);
+}
+
+static void test_faulting_store()
+{
+	Assembler a;
+	a.li(10, 0x20000);
+	a.addi(5, 0, 123);
+	a.sw(5, 10, 0);
+	a.lw(6, 10, 0);
+	a.li(11, Assembler::BASE);
+	const uint32_t store = a.pc();
+	a.sw(6, 11, 8); // the execute segment is read-only
+	a.addi(6, 6, 1);
+	a.exit();
+
+	const auto outcome = differential(a);
+	assert(outcome.fault == PROTECTION_FAULT);
+	assert(outcome.pc == store);
+	assert(outcome.regs[6] == 123);
+}
+
+static void test_misaligned_jalr()
+{
+	Assembler a;
+	a.auipc(5, 0);
+	a.jalr(1, 5, 17); // odd, even with compressed instructions
+	a.addi(6, 0, 1);
+	a.exit();
+	a.addi(6, 0, 2);
+	a.exit();
+
+	const auto outcome = differential(a);
+	assert(outcome.fault == MISALIGNED_INSTRUCTION);
+	assert(outcome.regs[6] == 0x6001);
+}
+
+void test_jit()
+{
+	test_branches();
+	test_faulting_load();
+	test_faulting_store();
+	test_misaligned_jalr();
+}
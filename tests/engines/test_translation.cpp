@@ -0,0 +1,125 @@
+#include "guest.hpp"
+#include <array>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace riscv;
+static constexpr uint64_t MEMORY = 4ull << 20;
+static constexpr uint32_t UNREADABLE = 0x80000;
+
+#ifdef RISCV_BINARY_TRANSLATION
+// translates the program, and builds it with the host compiler,
+// the same way rvtranslate does
+static std::string translate(const std::vector<uint8_t>& binary, const char* dir)
+{
+	Machine<RISCV32> machine { binary, MEMORY };
+	const auto source = Translation<RISCV32>::generate(machine);
+	const std::string source_file = std::string(dir) + "/program.c";
+	const std::string output = std::string(dir) + "/program.so";
+	FILE* f = fopen(source_file.c_str(), "wb");
+	assert(f != nullptr);
+	const size_t written = fwrite(source.data(), 1, source.size(), f);
+	fclose(f);
+	assert(written == source.size());
+
+	const char* cc = getenv("CC");
+	const char* argv[] = { (cc != nullptr) ? cc : "cc",
+		"-O2", "-shared", "-fPIC", "-o", output.c_str(), source_file.c_str(), nullptr };
+	const pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		execvp(argv[0], (char* const*) argv);
+		_exit(127);
+	}
+	int status = 0;
+	const pid_t waited = waitpid(pid, &status, 0);
+	assert(waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	unlink(source_file.c_str());
+	return output;
+}
+
+struct Outcome {
+	std::array<uint32_t, 32> regs;
+	uint32_t pc;
+	uint64_t counter;
+	int      fault;
+	uint32_t stored;
+
+	bool operator== (const Outcome& other) const noexcept {
+		return regs == other.regs && pc == other.pc && counter == other.counter
+			&& fault == other.fault && stored == other.stored;
+	}
+};
+
+static Outcome execute(Machine<RISCV32>& machine, uint32_t entry)
+{
+	install_exit(machine);
+	machine.memory.set_page_attr(UNREADABLE, Page::size(), {
+		.read = false, .write = false, .exec = false
+	});
+	for (int reg = 1; reg < 32; reg++)
+		machine.cpu.reg(reg) = 0x1000 * reg + 1;
+	machine.cpu.jump(entry);
+	Outcome outcome {};
+	outcome.fault = run(machine);
+	for (int reg = 0; reg < 32; reg++)
+		outcome.regs[reg] = machine.cpu.reg(reg);
+	outcome.pc = machine.cpu.pc();
+	outcome.counter = machine.cpu.instruction_counter();
+	outcome.stored = machine.memory.read<uint32_t> (0x20000);
+	return outcome;
+}
+#endif
+
+// translated programs must end exactly like interpreted ones
+void test_translation()
+{
+#ifdef RISCV_BINARY_TRANSLATION
+	Assembler a;
+	// sum the first 100 words of the program into memory
+	a.li(10, Assembler::BASE);
+	a.li(11, 0x20000);
+	a.addi(5, 0, 100);
+	a.addi(7, 0, 0);
+	const uint32_t loop = a.pc();
+	a.lw(6, 10, 0);
+	a.add(7, 7, 6);
+	a.srai(8, 7, 0);
+	a.addi(10, 10, 4);
+	a.addi(5, 5, -1);
+	a.blt(0, 5, loop);
+	a.sw(7, 11, 0);
+	a.exit();
+	// the same, but ending with a faulting load
+	const uint32_t faulting = a.pc();
+	a.li(11, UNREADABLE);
+	a.addi(5, 0, 5);
+	a.lw(6, 11, 0);
+	a.exit();
+	const auto binary = build_elf(a);
+
+	char dir[] = "/tmp/rvtranslate-XXXXXX";
+	const char* created = mkdtemp(dir);
+	assert(created != nullptr);
+	const auto library = translate(binary, dir);
+
+	for (const uint32_t entry : { Assembler::BASE, faulting }) {
+		Machine<RISCV32> interpreted { binary, MEMORY };
+		Machine<RISCV32> translated { binary, MEMORY };
+		const bool loaded = translated.cpu.load_translation(library);
+		assert(loaded);
+		const auto expected = execute(interpreted, entry);
+		assert(execute(translated, entry) == expected);
+		assert(expected.fault == ((entry == faulting) ? PROTECTION_FAULT : -1));
+	}
+	// a shared object made from another program is not used
+	a.exit();
+	const auto other = build_elf(a);
+	Machine<RISCV32> machine { other, MEMORY };
+	const bool loaded = machine.cpu.load_translation(library);
+	assert(!loaded);
+
+	unlink(library.c_str());
+	rmdir(dir);
+#endif
+}
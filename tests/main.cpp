@@ -2,6 +2,10 @@
 
 extern void test_custom_machine();
 extern void test_crashes();
+extern void test_checkpoint();
+extern void test_fork();
+extern void test_memops();
+extern void test_devices();
 extern void test_rv32i();
 extern void test_rv32c();
 
@@ -10,6 +14,10 @@ int main()
 	test_custom_machine();
 
 	test_crashes();
+	test_checkpoint();
+	test_fork();
+	test_memops();
+	test_devices();
 	test_rv32i();
 	test_rv32c();
 	printf("Tests passed!\n");
@@ -0,0 +1,33 @@
+#include <libriscv/machine.hpp>
+#include <cassert>
+
+void test_checkpoint()
+{
+	const uint32_t memory = 65536;
+	riscv::Machine<riscv::RISCV32> m { {}, memory };
+	m.memory.write<uint32_t> (0x1000, 1);
+	m.memory.write<uint32_t> (0x2000, 2);
+	m.cpu.jump(0x1000);
+
+	m.checkpoint();
+	assert(m.memory.dirty_pages() == 0);
+	m.memory.write<uint32_t> (0x1000, 3);      // changed
+	m.memory.write<uint32_t> (0x3000, 4);      // created
+	m.memory.free_pages(0x2000, riscv::Page::size()); // freed
+	m.cpu.jump(0x3000);
+	assert(m.memory.dirty_pages() == 3);
+
+	const size_t pages = m.memory.pages_active();
+	m.restore_checkpoint();
+	assert(m.memory.pages_active() == pages); // one back, one gone
+	assert(m.memory.dirty_pages() == 0);
+	assert(m.memory.read<uint32_t> (0x1000) == 1);
+	assert(m.memory.read<uint32_t> (0x2000) == 2);
+	assert(m.memory.read<uint32_t> (0x3000) == 0);
+	assert(m.cpu.registers().pc == 0x1000);
+
+	// the checkpoint is kept
+	m.memory.write<uint32_t> (0x1000, 5);
+	m.restore_checkpoint();
+	assert(m.memory.read<uint32_t> (0x1000) == 1);
+}
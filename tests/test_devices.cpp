@@ -0,0 +1,74 @@
+#include <libriscv/machine.hpp>
+#include <cassert>
+using namespace riscv;
+
+struct Registers32 {
+	uint32_t regs[2 * Page::SIZE / 4] = {};
+	int accesses = 0;
+};
+
+void test_devices()
+{
+	const uint32_t memory = 65536;
+	Machine<RISCV32> machine { std::vector<uint8_t>{}, memory };
+	auto& mem = machine.memory;
+
+	// a device with handlers, over two pages
+	static Registers32 state;
+	const uint32_t base = 0x20000;
+	mem.add_device({
+		.base = base, .size = 2 * Page::size(),
+		.read = [] (uint32_t off, int) -> uint64_t {
+			state.accesses++;
+			return state.regs[off / 4];
+		},
+		.write = [] (uint32_t off, int, uint64_t value) {
+			state.accesses++;
+			state.regs[off / 4] = value;
+		},
+	});
+	mem.write<uint32_t> (base + Page::size() + 8, 1234);
+	assert(state.regs[(Page::size() + 8) / 4] == 1234);
+	assert(mem.read<uint32_t> (base + Page::size() + 8) == 1234);
+	// every access goes to the device
+	assert(mem.read<uint32_t> (base + Page::size() + 8) == 1234);
+	assert(state.accesses == 3);
+	assert(mem.device_at(base + 100) != nullptr);
+	assert(mem.device_at(base + 2 * Page::size()) == nullptr);
+
+	bool overlapped = false;
+	try {
+		mem.add_device({ .base = base + Page::size(), .size = Page::size() });
+	} catch (const MachineException& e) {
+		overlapped = e.type() == ILLEGAL_OPERATION;
+	}
+	assert(overlapped);
+
+	// a RAM-like device is mapped as pages of its memory
+	alignas(Page::SIZE) static uint8_t framebuffer[4 * Page::SIZE];
+	const uint32_t fb = 0x30000;
+	mem.add_device({ .base = fb, .size = sizeof(framebuffer), .data = framebuffer });
+	mem.write<uint32_t> (fb + 16, 0xAABBCCDD);
+	assert(framebuffer[16] == 0xDD);
+	mem.memset(fb + Page::size() - 2, 0x11, 4);
+	assert(framebuffer[Page::size() + 1] == 0x11);
+	const auto buffers = mem.gather(fb, sizeof(framebuffer));
+	assert(buffers.size() == 1 && buffers[0].ptr == framebuffer);
+
+	// forks map the same memory, and the writes of both machines reach it
+	if constexpr (!flat_memory_enabled) {
+		auto child = machine.fork();
+		mem.write<uint32_t> (fb + 32, 1);
+		child->memory.write<uint32_t> (fb + 36, 2);
+		assert(framebuffer[32] == 1 && framebuffer[36] == 2);
+		assert(child->memory.read<uint32_t> (fb + 32) == 1);
+		assert(mem.read<uint32_t> (fb + 36) == 2);
+		assert(child->memory.gather(fb, sizeof(framebuffer))[0].ptr == framebuffer);
+	}
+
+	// without the device, it is ordinary memory again
+	mem.remove_device(base);
+	assert(mem.read<uint32_t> (base + Page::size() + 8) == 0);
+	mem.write<uint32_t> (base, 1);
+	assert(state.regs[0] == 0);
+}
@@ -0,0 +1,50 @@
+#include <libriscv/machine.hpp>
+#include <cassert>
+
+static int execute_at(riscv::Machine<riscv::RISCV32>& machine, uint32_t addr)
+{
+	machine.cpu.jump(addr);
+	try {
+		machine.simulate(100);
+	} catch (const riscv::MachineException& e) {
+		return e.type();
+	}
+	return -1;
+}
+
+void test_fork()
+{
+	if constexpr (riscv::flat_memory_enabled) return;
+	const uint32_t memory = 65536;
+	auto parent = std::make_unique<riscv::Machine<riscv::RISCV32>> (
+		std::vector<uint8_t>{}, memory);
+	parent->memory.write<uint32_t> (0x1000, 1);
+	parent->memory.write<uint32_t> (0x2000, 2);
+	parent->cpu.jump(0x1000);
+
+	auto child = parent->fork();
+	assert(child->cpu.registers().pc == 0x1000);
+	assert(child->memory.nonshared_pages_active() == 0);
+	assert(child->memory.read<uint32_t> (0x2000) == 2);
+	// writes make copies, and are not seen by the other machine
+	child->memory.write<uint32_t> (0x1000, 3);
+	child->memory.memset(0x2000, 0xFF, 4);
+	parent->memory.memcpy(0x2004, "\x01", 1);
+	assert(child->memory.nonshared_pages_active() == 2);
+	assert(parent->memory.read<uint32_t> (0x1000) == 1);
+	assert(parent->memory.read<uint32_t> (0x2000) == 2);
+	assert(child->memory.read<uint32_t> (0x1000) == 3);
+	assert(child->memory.read<uint32_t> (0x2000) == 0xFFFFFFFF);
+	assert(child->memory.read<uint8_t> (0x2004) == 0);
+	// executing the zero page faults in both machines
+	const int fault = execute_at(*parent, 0);
+	assert(fault == riscv::PROTECTION_FAULT
+		|| fault == riscv::EXECUTION_SPACE_PROTECTION_FAULT);
+	assert(execute_at(*child, 0) == fault);
+
+	// the shared pages outlive the parent
+	auto grandchild = child->fork();
+	parent.reset();
+	assert(grandchild->memory.read<uint32_t> (0x1000) == 3);
+	assert(grandchild->memory.read<uint32_t> (0x2004) == 0);
+}
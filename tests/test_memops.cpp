@@ -0,0 +1,97 @@
+#include <libriscv/machine.hpp>
+#include <cassert>
+using namespace riscv;
+
+void test_memops()
+{
+	const uint32_t memory = 65536;
+	Machine<RISCV32> machine { std::vector<uint8_t>{}, memory };
+	auto& mem = machine.memory;
+
+	// spans that cross pages, on both sides
+	mem.fill(0x1FF0, 0xAB, 0x20);
+	assert(mem.read<uint32_t> (0x1FFC) == 0xABABABAB);
+	assert(mem.read<uint8_t> (0x2010) == 0);
+	for (uint32_t i = 0; i < 0x2000; i++)
+		mem.write<uint8_t> (0x3000 + i, i);
+	mem.copy_within(0x6008, 0x3000, 0x2000);
+	assert(mem.read<uint8_t> (0x6008 + 0x1FFF) == 0xFF);
+	assert(mem.read<uint32_t> (0x7000) == 0xFBFAF9F8);
+
+	// overlapping moves, in both directions
+	mem.move(0x3010, 0x3000, 0x1800);
+	assert(mem.read<uint8_t> (0x3010) == 0);
+	assert(mem.read<uint8_t> (0x3010 + 0x17FF) == 0xFF);
+	mem.move(0x3000, 0x3010, 0x1800);
+	assert(mem.read<uint8_t> (0x3000 + 0x1234) == 0x34);
+
+	// zeroing gives whole pages back, and clears the edges
+	const size_t pages = mem.pages_active();
+	mem.zero_range(0x3001, 0x1FFF);
+	assert(mem.pages_active() == pages - 1);
+	assert(mem.read<uint8_t> (0x3000) == 0x00);
+	assert(mem.read<uint8_t> (0x3001) == 0x00);
+	assert(mem.read<uint8_t> (0x4FFF) == 0x00);
+	mem.zero_range(0xA000, 0x10000);
+	assert(mem.pages_active() == pages - 1);
+	for (uint32_t i = 0; i < 0x2000; i++)
+		mem.write<uint8_t> (0x3000 + i, i);
+
+	// views of guest memory, merged when the pages are next to each other
+	const auto buffers = mem.gather(0x3FF0, 0x20);
+	size_t total = 0;
+	for (const auto& buf : buffers) total += buf.len;
+	assert(total == 0x20 && buffers.front().ptr[0] == 0xF0);
+	assert(buffers.size() <= 2);
+
+	// permissions are checked
+	mem.set_page_attr(0x8000, Page::size(), {.read = true, .write = false});
+	bool faulted = false;
+	try {
+		mem.fill(0x7FF0, 0, 0x20);
+	} catch (const MachineException& e) {
+		faulted = e.type() == PROTECTION_FAULT;
+	}
+	assert(faulted);
+	assert(mem.read<uint8_t> (0x8000) == 0xF8);
+
+	// and traps see every byte
+	if constexpr (memory_traps_enabled && !flat_memory_enabled) {
+		int writes = 0;
+		mem.trap(0x9000,
+			[&writes] (Page& page, uint32_t off, int mode, int64_t value) -> int64_t {
+				if (Page::trap_mode(mode) == TRAP_WRITE) writes++;
+				return page.passthrough(off, mode, value);
+			});
+		mem.copy_within(0x9000, 0x3000, 16);
+		assert(writes == 16);
+		assert(mem.read<uint8_t> (0x900F) == 0x0F);
+		// and the page can not be viewed around its trap
+		faulted = false;
+		try {
+			mem.gather(0x8FF0, 0x20);
+		} catch (const MachineException& e) {
+			faulted = e.type() == PROTECTION_FAULT;
+		}
+		assert(faulted);
+	}
+
+	// the page data of a machine is reused by it, and goes back all at once
+	if constexpr (!flat_memory_enabled) {
+		Machine<RISCV32> other { std::vector<uint8_t>{}, 16 * Page::size() };
+		const size_t empty = PagePool::data_stats().in_use;
+		size_t chunks = 0;
+		for (int round = 0; round < 2; round++) {
+			for (uint32_t i = 1; i <= 8; i++)
+				other.memory.write<uint8_t> (i * Page::size(), i);
+			assert(PagePool::data_stats().in_use == empty + 8);
+			other.memory.free_pages(Page::size(), Page::size());
+			assert(PagePool::data_stats().in_use == empty + 7);
+			other.memory.write<uint8_t> (Page::size(), 1);
+			if (round == 0) chunks = PagePool::data_stats().chunks;
+			assert(PagePool::data_stats().chunks == chunks);
+			other.memory.reset();
+			assert(PagePool::data_stats().in_use == empty);
+		}
+	}
+}
@@ -92,13 +92,13 @@ protected_execute(const Request& req, Response& res, const ContentReader& creade
 		// reset PC here for benchmarking
 		machine.cpu.reset_instruction_counter();
 		// take a snapshot of the machine
-		std::vector<uint8_t> program_state;
-		machine.serialize_to(program_state);
+		machine.checkpoint();
 		std::deque<uint64_t> samples;
 		// begin benchmarking 1 + N samples
 		for (int i = 0; i < 1 + BENCH_SAMPLES; i++)
 		{
-			machine.deserialize_from(program_state);
+			// undo the pages the previous sample changed
+			machine.restore_checkpoint();
 			state.output.clear();
 			const uint64_t t0 = micros_now();
 			asm("" : : : "memory");
@@ -138,11 +138,11 @@ protected_execute(const Request& req, Response& res, const ContentReader& creade
 		const auto instructions = std::to_string(machine.cpu.instruction_counter());
 		res.set_header("X-Instruction-Count", instructions);
 		res.set_header("X-Binary-Size", std::to_string(binary.size()));
-		const size_t active_mem = machine.memory.pages_active() * 4096;
+		const size_t active_mem = machine.memory.pages_active() * riscv::Page::size();
 		res.set_header("X-Memory-Usage", std::to_string(active_mem));
-		const size_t highest_mem = machine.memory.pages_highest_active() * 4096;
+		const size_t highest_mem = machine.memory.pages_highest_active() * riscv::Page::size();
 		res.set_header("X-Memory-Highest", std::to_string(highest_mem));
-		const size_t max_mem = machine.memory.pages_total() * 4096;
+		const size_t max_mem = machine.memory.pages_total() * riscv::Page::size();
 		res.set_header("X-Memory-Max", std::to_string(highest_mem));
 		res.set_content(state.output, "text/plain");
 	}